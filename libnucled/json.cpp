@@ -0,0 +1,184 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * libnucled: just enough JSON for configuration files.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include "json.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+namespace nucled {
+
+namespace {
+
+class json_parser {
+public:
+	explicit json_parser(const std::string &text) : p_(text.c_str()) {}
+
+	json_value parse()
+	{
+		json_value v = value();
+
+		skip_space();
+		if (*p_)
+			fail("trailing data");
+		return v;
+	}
+
+private:
+	const char *p_;
+
+	[[noreturn]] void fail(const char *what)
+	{
+		throw std::invalid_argument(std::string("invalid JSON: ") +
+					    what);
+	}
+
+	void skip_space()
+	{
+		while (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r')
+			p_++;
+	}
+
+	void expect(char c)
+	{
+		skip_space();
+		if (*p_ != c)
+			fail("unexpected character");
+		p_++;
+	}
+
+	bool literal(const char *word)
+	{
+		size_t len = strlen(word);
+
+		if (strncmp(p_, word, len))
+			return false;
+		p_ += len;
+		return true;
+	}
+
+	std::string string()
+	{
+		std::string s;
+
+		expect('"');
+		for (; *p_ != '"'; p_++) {
+			if (!*p_)
+				fail("unterminated string");
+			if (*p_ != '\\') {
+				s += *p_;
+				continue;
+			}
+			switch (*++p_) {
+			case '"':
+			case '\\':
+			case '/':
+				s += *p_;
+				break;
+			case 'n':
+				s += '\n';
+				break;
+			case 't':
+				s += '\t';
+				break;
+			default:
+				fail("unsupported escape");
+			}
+		}
+		p_++;
+		return s;
+	}
+
+	json_value value()
+	{
+		json_value v;
+		char *end;
+
+		skip_space();
+		switch (*p_) {
+		case '{':
+			v.type = json_value::object;
+			p_++;
+			skip_space();
+			if (*p_ == '}') {
+				p_++;
+				break;
+			}
+			for (;;) {
+				v.keys.push_back(string());
+				expect(':');
+				v.items.push_back(value());
+				skip_space();
+				if (*p_ != ',')
+					break;
+				p_++;
+			}
+			expect('}');
+			break;
+		case '[':
+			v.type = json_value::array;
+			p_++;
+			skip_space();
+			if (*p_ == ']') {
+				p_++;
+				break;
+			}
+			for (;;) {
+				v.items.push_back(value());
+				skip_space();
+				if (*p_ != ',')
+					break;
+				p_++;
+			}
+			expect(']');
+			break;
+		case '"':
+			v.type = json_value::string;
+			v.s = string();
+			break;
+		default:
+			if (literal("true")) {
+				v.type = json_value::boolean;
+				v.b = true;
+			} else if (literal("false")) {
+				v.type = json_value::boolean;
+			} else if (literal("null")) {
+				v.type = json_value::null;
+			} else {
+				v.type = json_value::number;
+				v.n = strtod(p_, &end);
+				if (end == p_)
+					fail("unexpected character");
+				p_ = end;
+			}
+		}
+		return v;
+	}
+};
+
+} // namespace
+
+const json_value *json_value::get(const std::string &key) const
+{
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (keys[i] == key)
+			return &items[i];
+	}
+	return nullptr;
+}
+
+json_value parse_json(const std::string &text)
+{
+	return json_parser(text).parse();
+}
+
+} // namespace nucled
@@ -0,0 +1,40 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * libnucled: just enough JSON for configuration files.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef NUCLED_JSON_H
+#define NUCLED_JSON_H
+
+#include <string>
+#include <vector>
+
+namespace nucled {
+
+struct json_value {
+	enum { null, boolean, number, string, array, object } type = null;
+	bool b = false;
+	double n = 0;
+	std::string s;
+	std::vector<json_value> items; /* array elements, object values */
+	std::vector<std::string> keys; /* object keys */
+
+	/* The value of key in an object, NULL if there is none */
+	const json_value *get(const std::string &key) const;
+};
+
+/*
+ * Objects, arrays, strings without \u escapes, numbers, true, false and
+ * null. Throws std::invalid_argument.
+ */
+json_value parse_json(const std::string &text);
+
+} // namespace nucled
+
+#endif
@@ -0,0 +1,423 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * libnucled: C++ client of /dev/nuc_led.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include "nucled.h"
+#include "json.h"
+#include "../nuc_led_layout.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace nucled {
+
+namespace {
+
+static_assert(power_state == NUCLED_USAGE_TYPE_POWER_STATE &&
+		      hdd_activity == NUCLED_USAGE_TYPE_HDD_ACTIVITY &&
+		      ethernet == NUCLED_USAGE_TYPE_ETHERNET &&
+		      wifi == NUCLED_USAGE_TYPE_WIFI &&
+		      software == NUCLED_USAGE_TYPE_SOFTWARE &&
+		      power_limit == NUCLED_USAGE_TYPE_POWER_LIMIT &&
+		      disable == NUCLED_USAGE_TYPE_DISABLE,
+	      "enum indicator must match the usage types of nuc_led_layout.h");
+
+/* Names the Python controller used, on top of the driver's */
+const std::pair<const char *, uint8_t> led_aliases[] = {
+	{ "button", 0 }, { "f1", 4 }, { "f2", 5 }, { "f3", 6 },
+};
+
+const std::pair<const char *, uint8_t> indicator_aliases[] = {
+	{ "power", power_state }, { "hddio", hdd_activity },
+	{ "netio", ethernet },	  { "off", disable },
+};
+
+/* The field tables of the indicator layouts, as fields */
+const std::vector<field> &fields_of(uint8_t indicator)
+{
+	static const std::vector<std::vector<field>> tables = [] {
+		std::vector<std::vector<field>> t;
+
+		for (auto &layout : nuc_led_indicator_layouts) {
+			std::vector<field> fields;
+
+			for (size_t i = 0; i < layout.num_fields; i++)
+				fields.push_back({ layout.fields[i].name,
+						   layout.fields[i].item_id });
+			t.push_back(std::move(fields));
+		}
+		return t;
+	}();
+	static const std::vector<field> none;
+
+	return indicator < tables.size() ? tables[indicator] : none;
+}
+
+bool parse_number(const std::string &s, unsigned long max, unsigned long &n)
+{
+	char *end;
+
+	if (s.empty() || s[0] == '-')
+		return false;
+	errno = 0;
+	n = strtoul(s.c_str(), &end, 0);
+	return !errno && !*end && n <= max;
+}
+
+[[noreturn]] void config_error(size_t entry, const std::string &what)
+{
+	throw std::invalid_argument("lights[" + std::to_string(entry) +
+				    "]: " + what);
+}
+
+/* A byte, as a JSON number or a string holding one like "100" */
+uint8_t config_byte(size_t entry, const std::string &key, const json_value &v)
+{
+	unsigned long n;
+
+	if (v.type == json_value::number && v.n >= 0 && v.n <= 255 &&
+	    v.n == (uint8_t)v.n)
+		return v.n;
+	if (v.type == json_value::string && parse_number(v.s, 255, n))
+		return n;
+	config_error(entry, key + " must be a number from 0 to 255");
+}
+
+std::string config_string(size_t entry, const std::string &key,
+			  const json_value &v)
+{
+	if (v.type == json_value::string)
+		return v.s;
+	if (v.type == json_value::number)
+		return std::to_string((long)v.n);
+	config_error(entry, key + " must be a string");
+}
+
+void config_set(led_config &led, size_t entry, const std::string &name,
+		uint8_t value)
+{
+	uint8_t item;
+
+	if (!parse_field(led.indicator, name, item))
+		config_error(entry, std::string(indicator_name(led.indicator)) +
+					    " has no field " + name);
+
+	// A later value for the same item wins
+	for (auto &v : led.values) {
+		if (v.first == item) {
+			v.second = value;
+			return;
+		}
+	}
+	led.values.emplace_back(item, value);
+}
+
+led_config config_entry(size_t entry, const json_value &obj)
+{
+	const json_value *brightness = nullptr, *color = nullptr;
+	const json_value *fields = nullptr;
+	std::string led, indicator, slot;
+	led_config config;
+
+	if (obj.type != json_value::object)
+		config_error(entry, "must be an object");
+
+	for (size_t i = 0; i < obj.keys.size(); i++) {
+		const std::string &key = obj.keys[i];
+		const json_value &v = obj.items[i];
+
+		if (key == "led")
+			led = config_string(entry, key, v);
+		else if (key == "indicator" || key == "source")
+			indicator = config_string(entry, key, v);
+		else if (key == "slot")
+			slot = config_string(entry, key, v);
+		else if (key == "brightness")
+			brightness = &v;
+		else if (key == "color")
+			color = &v;
+		else if (key == "fields" && v.type == json_value::object)
+			fields = &v;
+		else
+			config_error(entry, "unknown key " + key);
+	}
+
+	if (!parse_led(led, config.led_type))
+		config_error(entry, "unknown led '" + led + "'");
+	if (!parse_indicator(indicator, config.indicator))
+		config_error(entry, "unknown indicator '" + indicator + "'");
+
+	// brightness and color address the first color, or the one in slot
+	if (!slot.empty())
+		slot += '_';
+	else if (config.indicator == power_state)
+		slot = "s0_";
+
+	if (brightness)
+		config_set(config, entry, slot + "brightness",
+			   config_byte(entry, "brightness", *brightness));
+	if (color) {
+		std::string hex = config_string(entry, "color", *color);
+		unsigned long rgb;
+
+		if (hex.size() != 7 || hex[0] != '#' ||
+		    !parse_number("0x" + hex.substr(1), 0xffffff, rgb))
+			config_error(entry, "color must look like #rrggbb");
+		config_set(config, entry, slot + "red", rgb >> 16);
+		config_set(config, entry, slot + "green", (rgb >> 8) & 0xff);
+		config_set(config, entry, slot + "blue", rgb & 0xff);
+	}
+	for (size_t i = 0; fields && i < fields->keys.size(); i++)
+		config_set(config, entry, fields->keys[i],
+			   config_byte(entry, fields->keys[i],
+				       fields->items[i]));
+
+	return config;
+}
+
+} // namespace
+
+const char *led_name(uint8_t led_type)
+{
+	return led_type < std::size(led_short_names) ? led_short_names[led_type] :
+						       nullptr;
+}
+
+bool parse_led(const std::string &name, uint8_t &led_type)
+{
+	unsigned long n;
+
+	for (uint8_t i = 0; i < std::size(led_short_names); i++) {
+		if (name == led_short_names[i]) {
+			led_type = i;
+			return true;
+		}
+	}
+	for (auto &alias : led_aliases) {
+		if (name == alias.first) {
+			led_type = alias.second;
+			return true;
+		}
+	}
+	if (!parse_number(name, NUCLED_MAX_LEDS - 1, n))
+		return false;
+	led_type = n;
+	return true;
+}
+
+const char *indicator_name(uint8_t indicator)
+{
+	// disable has no values, so no layout
+	if (indicator == disable)
+		return "disable";
+	return indicator < std::size(nuc_led_indicator_layouts) ?
+		       nuc_led_indicator_layouts[indicator].name :
+		       nullptr;
+}
+
+bool parse_indicator(const std::string &name, uint8_t &indicator)
+{
+	unsigned long n;
+
+	for (uint8_t i = 0; i <= disable; i++) {
+		if (name == indicator_name(i)) {
+			indicator = i;
+			return true;
+		}
+	}
+	for (auto &alias : indicator_aliases) {
+		if (name == alias.first) {
+			indicator = alias.second;
+			return true;
+		}
+	}
+	if (!parse_number(name, disable, n))
+		return false;
+	indicator = n;
+	return true;
+}
+
+const std::vector<field> &indicator_fields(uint8_t indicator)
+{
+	return fields_of(indicator);
+}
+
+bool parse_field(uint8_t indicator, const std::string &name, uint8_t &item)
+{
+	const std::vector<field> &fields = fields_of(indicator);
+	unsigned long n;
+
+	for (auto &f : fields) {
+		if (name == f.name) {
+			item = f.item;
+			return true;
+		}
+	}
+	if (fields.empty() || !parse_number(name, fields.size() - 1, n))
+		return false;
+	item = n;
+	return true;
+}
+
+void batch::set_indicator(uint8_t led_type, uint8_t indicator)
+{
+	nuc_led_ioc_op op = {};
+
+	op.action = NUCLED_OP_SET_INDICATOR;
+	op.led_type = led_type;
+	op.indicator_option = indicator;
+	ops_.push_back(op);
+}
+
+void batch::set_value(uint8_t led_type, uint8_t indicator, uint8_t item,
+		      uint8_t value)
+{
+	nuc_led_ioc_op op = {};
+
+	op.action = NUCLED_OP_SET_VALUE;
+	op.led_type = led_type;
+	op.indicator_option = indicator;
+	op.item = item;
+	op.value = value;
+	ops_.push_back(op);
+}
+
+device::device(const char *path, bool writable)
+{
+	fd_ = open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if (fd_ < 0)
+		throw std::system_error(errno, std::generic_category(), path);
+}
+
+device::~device()
+{
+	close(fd_);
+}
+
+std::vector<nuc_led_ioc_led> device::leds() const
+{
+	nuc_led_ioc_table table = {};
+
+	if (ioctl(fd_, NUCLED_IOC_GET_LEDS, &table))
+		throw std::system_error(errno, std::generic_category(),
+					"NUCLED_IOC_GET_LEDS");
+	if (table.version != NUCLED_IOC_VERSION)
+		throw std::system_error(EPROTO, std::generic_category(),
+					"NUCLED_IOC_GET_LEDS");
+
+	return std::vector<nuc_led_ioc_led>(
+		table.leds,
+		table.leds + std::min<uint32_t>(table.num_leds,
+						NUCLED_MAX_LEDS));
+}
+
+nuc_led_ioc_indicator device::get_indicator(uint8_t led_type,
+					    uint8_t indicator) const
+{
+	nuc_led_ioc_indicator ind = {};
+
+	ind.led_type = led_type;
+	ind.indicator_option = indicator;
+	if (ioctl(fd_, NUCLED_IOC_GET_INDICATOR, &ind))
+		throw std::system_error(errno, std::generic_category(),
+					"NUCLED_IOC_GET_INDICATOR");
+	return ind;
+}
+
+size_t device::apply(batch &b)
+{
+	std::vector<nuc_led_ioc_op> &ops = b.ops();
+	size_t failed = 0;
+
+	for (size_t i = 0; i < ops.size(); i += NUCLED_IOC_MAX_OPS) {
+		nuc_led_ioc_ops req = {};
+
+		req.count = std::min<size_t>(ops.size() - i, NUCLED_IOC_MAX_OPS);
+		req.ops = (uintptr_t)&ops[i];
+
+		if (ioctl(fd_, NUCLED_IOC_APPLY, &req))
+			throw std::system_error(errno, std::generic_category(),
+						"NUCLED_IOC_APPLY");
+		for (size_t j = i; j < i + req.count; j++)
+			failed += ops[j].result != 0;
+	}
+	return failed;
+}
+
+std::vector<led_config> parse_config(const std::string &json)
+{
+	json_value root = parse_json(json);
+	const json_value *lights = root.get("lights");
+	std::vector<led_config> config;
+
+	if (!lights || lights->type != json_value::array)
+		throw std::invalid_argument("missing \"lights\" array");
+
+	for (size_t i = 0; i < lights->items.size(); i++)
+		config.push_back(config_entry(i, lights->items[i]));
+	return config;
+}
+
+batch diff(const device &dev, const std::vector<led_config> &config)
+{
+	std::vector<nuc_led_ioc_led> leds = dev.leds();
+	batch b;
+
+	for (const led_config &want : config) {
+		auto led = std::find_if(leds.begin(), leds.end(),
+					[&](const nuc_led_ioc_led &l) {
+						return l.led_type ==
+						       want.led_type;
+					});
+
+		if (led == leds.end()) {
+			const char *name = led_name(want.led_type);
+
+			throw std::invalid_argument(std::string("no LED ") +
+						    (name ? name : "?"));
+		}
+
+		// Track what the batch does, later entries may be the same LED
+		if (led->indicator_option != want.indicator) {
+			b.set_indicator(want.led_type, want.indicator);
+			led->indicator_option = want.indicator;
+			led->indicator_size = 0;
+			if (!want.values.empty()) {
+				nuc_led_ioc_indicator ind = dev.get_indicator(
+					want.led_type, want.indicator);
+
+				led->indicator_size = ind.size;
+				memcpy(led->indicator, ind.values,
+				       sizeof(led->indicator));
+			}
+		}
+
+		for (auto &v : want.values) {
+			if (v.first < led->indicator_size &&
+			    led->indicator[v.first] == v.second)
+				continue;
+			b.set_value(want.led_type, want.indicator, v.first,
+				    v.second);
+			if (v.first < led->indicator_size)
+				led->indicator[v.first] = v.second;
+		}
+	}
+	return b;
+}
+
+} // namespace nucled
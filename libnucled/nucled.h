@@ -0,0 +1,106 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * libnucled: C++ client of /dev/nuc_led. One open handle, typed LEDs,
+ * indicators and fields, and changes batched into NUCLED_IOC_APPLY.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef NUCLED_H
+#define NUCLED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../nuc_led_ioctl.h"
+
+namespace nucled {
+
+/* Indicator options, the INDICATOR_OPTIONS bit numbers */
+enum indicator : uint8_t {
+	power_state = 0,
+	hdd_activity = 1,
+	ethernet = 2,
+	wifi = 3,
+	software = 4,
+	power_limit = 5,
+	disable = 6,
+};
+
+/* One item of an indicator, named like /sys/kernel/nuc_led/<led>/<indicator>/<field> */
+struct field {
+	const char *name;
+	uint8_t item;
+};
+
+/* Names are the ones of /sys/kernel/nuc_led, NULL or false if unknown */
+const char *led_name(uint8_t led_type);
+bool parse_led(const std::string &name, uint8_t &led_type);
+const char *indicator_name(uint8_t indicator);
+bool parse_indicator(const std::string &name, uint8_t &indicator);
+const std::vector<field> &indicator_fields(uint8_t indicator);
+bool parse_field(uint8_t indicator, const std::string &name, uint8_t &item);
+
+/* Changes collected to be sent in as few NUCLED_IOC_APPLY calls as possible */
+class batch {
+public:
+	void set_indicator(uint8_t led_type, uint8_t indicator);
+	void set_value(uint8_t led_type, uint8_t indicator, uint8_t item,
+		       uint8_t value);
+
+	bool empty() const { return ops_.empty(); }
+	size_t size() const { return ops_.size(); }
+	/* After device::apply(), result holds 0 or a negative errno */
+	const std::vector<nuc_led_ioc_op> &ops() const { return ops_; }
+	std::vector<nuc_led_ioc_op> &ops() { return ops_; }
+
+private:
+	std::vector<nuc_led_ioc_op> ops_;
+};
+
+/* An open /dev/nuc_led. Failed syscalls throw std::system_error. */
+class device {
+public:
+	explicit device(const char *path = "/dev/nuc_led", bool writable = true);
+	~device();
+	device(const device &) = delete;
+	device &operator=(const device &) = delete;
+
+	/* Every LED with its current indicator and values, one ioctl */
+	std::vector<nuc_led_ioc_led> leds() const;
+	/* The values of any indicator of an LED, one ioctl */
+	nuc_led_ioc_indicator get_indicator(uint8_t led_type,
+					    uint8_t indicator) const;
+	/* Apply a batch in order, returns the number of ops that failed */
+	size_t apply(batch &b);
+
+private:
+	int fd_;
+};
+
+/* Desired state of one LED */
+struct led_config {
+	uint8_t led_type;
+	uint8_t indicator;
+	std::vector<std::pair<uint8_t, uint8_t>> values; /* item, value */
+};
+
+/*
+ * Parse a configuration, {"lights": [{"led": ..., "indicator": ...}]},
+ * see README.md. Throws std::invalid_argument.
+ */
+std::vector<led_config> parse_config(const std::string &json);
+
+/* The changes that take the LEDs from their current state to config */
+batch diff(const device &dev, const std::vector<led_config> &config);
+
+} // namespace nucled
+
+#endif
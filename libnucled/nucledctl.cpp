@@ -0,0 +1,223 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * nucledctl: show and change the LEDs through libnucled, or apply a
+ * configuration file, sending only what differs from the current state.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <getopt.h>
+
+#include "nucled.h"
+
+using namespace nucled;
+
+static const char *device_path = "/dev/nuc_led";
+static bool dry_run;
+
+[[noreturn]] static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: nucledctl [-hn] [-d device] <command>\n"
+		"\n"
+		"  show                                 print every LED and its current indicator\n"
+		"  get <led> <indicator>                print the values of any indicator\n"
+		"  set <led> <indicator> [field=value...]\n"
+		"                                       select an indicator and set its fields\n"
+		"  apply <config.json>                  apply a configuration, sending only changes\n"
+		"\n"
+		"  -d  device, default /dev/nuc_led\n"
+		"  -n  print the changes instead of applying them\n");
+	exit(status);
+}
+
+static uint8_t arg_led(const char *arg)
+{
+	uint8_t led_type;
+
+	if (!parse_led(arg, led_type))
+		throw std::invalid_argument(std::string("unknown led ") + arg);
+	return led_type;
+}
+
+static uint8_t arg_indicator(const char *arg)
+{
+	uint8_t indicator;
+
+	if (!parse_indicator(arg, indicator))
+		throw std::invalid_argument(std::string("unknown indicator ") +
+					    arg);
+	return indicator;
+}
+
+static void print_values(const char *led, uint8_t indicator,
+			 const uint8_t *values, uint8_t size)
+{
+	for (auto &f : indicator_fields(indicator)) {
+		if (f.item < size)
+			printf("%s.%s.%s=%u\n", led, indicator_name(indicator),
+			       f.name, values[f.item]);
+	}
+}
+
+static int cmd_show(device &dev)
+{
+	for (auto &led : dev.leds()) {
+		const char *name = led_name(led.led_type);
+		const char *indicator = indicator_name(led.indicator_option);
+
+		name = name ? name : "unknown";
+		printf("%s.indicator=%s\n", name,
+		       indicator ? indicator : "unknown");
+		print_values(name, led.indicator_option, led.indicator,
+			     led.indicator_size);
+	}
+	return 0;
+}
+
+static int cmd_get(device &dev, char **argv)
+{
+	uint8_t led_type = arg_led(argv[0]);
+	uint8_t indicator = arg_indicator(argv[1]);
+	nuc_led_ioc_indicator ind = dev.get_indicator(led_type, indicator);
+	const char *name = led_name(led_type);
+
+	print_values(name ? name : "unknown", indicator, ind.values, ind.size);
+	return 0;
+}
+
+/* Print a batch the way nuc_led.c logs commands */
+static void print_batch(const batch &b)
+{
+	for (auto &op : b.ops()) {
+		if (op.action == NUCLED_OP_SET_INDICATOR)
+			printf("set_indicator,%u,%u\n", op.led_type,
+			       op.indicator_option);
+		else
+			printf("set_indicator_value,%u,%u,%u,%u\n", op.led_type,
+			       op.indicator_option, op.item, op.value);
+	}
+}
+
+static int run_batch(device &dev, batch &b)
+{
+	size_t failed;
+
+	if (dry_run) {
+		print_batch(b);
+		return 0;
+	}
+	if (b.empty())
+		return 0;
+
+	failed = dev.apply(b);
+	for (auto &op : b.ops()) {
+		if (op.result)
+			fprintf(stderr, "LED %u indicator %u item %u: %s\n",
+				op.led_type, op.indicator_option, op.item,
+				strerror(-op.result));
+	}
+	return failed ? 1 : 0;
+}
+
+static int cmd_set(device &dev, int argc, char **argv)
+{
+	led_config config = { arg_led(argv[0]), arg_indicator(argv[1]), {} };
+	batch b;
+	int i;
+
+	for (i = 2; i < argc; i++) {
+		const char *value = strchr(argv[i], '=');
+		unsigned long n;
+		uint8_t item;
+		char *end;
+
+		if (!value)
+			throw std::invalid_argument(
+				std::string("expected field=value, got ") +
+				argv[i]);
+		if (!parse_field(config.indicator,
+				 std::string(argv[i], value - argv[i]), item))
+			throw std::invalid_argument(
+				std::string("unknown field ") + argv[i]);
+		n = strtoul(value + 1, &end, 0);
+		if (!value[1] || *end || n > 255)
+			throw std::invalid_argument(
+				std::string("invalid value ") + argv[i]);
+		config.values.emplace_back(item, n);
+	}
+
+	b = diff(dev, { config });
+	return run_batch(dev, b);
+}
+
+static int cmd_apply(device &dev, const char *path)
+{
+	std::ifstream file(path);
+	std::stringstream json;
+	batch b;
+
+	if (!file)
+		throw std::system_error(errno, std::generic_category(), path);
+	json << file.rdbuf();
+
+	b = diff(dev, parse_config(json.str()));
+	return run_batch(dev, b);
+}
+
+int main(int argc, char **argv)
+{
+	const char *cmd;
+	int opt, n;
+
+	while ((opt = getopt(argc, argv, "d:nh")) != -1) {
+		switch (opt) {
+		case 'd':
+			device_path = optarg;
+			break;
+		case 'n':
+			dry_run = true;
+			break;
+		default:
+			usage(opt == 'h' ? 0 : 2);
+		}
+	}
+	if (optind == argc)
+		usage(2);
+
+	cmd = argv[optind++];
+	n = argc - optind;
+	if (!(!strcmp(cmd, "show") && n == 0) &&
+	    !(!strcmp(cmd, "get") && n == 2) &&
+	    !(!strcmp(cmd, "set") && n >= 2) &&
+	    !(!strcmp(cmd, "apply") && n == 1))
+		usage(2);
+
+	try {
+		bool writable = !dry_run && (!strcmp(cmd, "set") ||
+					     !strcmp(cmd, "apply"));
+		device dev(device_path, writable);
+
+		if (!strcmp(cmd, "show"))
+			return cmd_show(dev);
+		if (!strcmp(cmd, "get"))
+			return cmd_get(dev, argv + optind);
+		if (!strcmp(cmd, "set"))
+			return cmd_set(dev, n, argv + optind);
+		return cmd_apply(dev, argv[optind]);
+	} catch (const std::exception &e) {
+		fprintf(stderr, "nucledctl: %s\n", e.what());
+		return 1;
+	}
+}
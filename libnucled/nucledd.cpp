@@ -0,0 +1,892 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * nucledd: drives LEDs from system metrics. A single epoll loop waits on
+ * a timerfd for the sampled metrics (CPU load from /proc/stat, hwmon
+ * temperatures), on a netlink socket for link and route changes and on
+ * a signalfd. Rules map every metric onto the color of an LED's Software
+ * indicator, and only colors that actually change are sent to the driver.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <getopt.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "json.h"
+#include "nucled.h"
+
+using namespace nucled;
+
+/* An owned file descriptor, closed when it goes away */
+class unique_fd {
+public:
+	unique_fd() = default;
+	explicit unique_fd(int fd) : fd_(fd) {}
+	unique_fd(unique_fd &&o) noexcept : fd_(std::exchange(o.fd_, -1)) {}
+	unique_fd(const unique_fd &) = delete;
+	~unique_fd() { reset(); }
+
+	unique_fd &operator=(unique_fd &&o) noexcept
+	{
+		if (this != &o) {
+			reset();
+			fd_ = std::exchange(o.fd_, -1);
+		}
+		return *this;
+	}
+	unique_fd &operator=(const unique_fd &) = delete;
+
+	int get() const { return fd_; }
+	void reset()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+		fd_ = -1;
+	}
+
+private:
+	int fd_ = -1;
+};
+
+enum metric_type { metric_cpu, metric_temp, metric_link, metric_route };
+
+struct rgb {
+	uint8_t red, green, blue;
+
+	bool operator!=(const rgb &o) const
+	{
+		return red != o.red || green != o.green || blue != o.blue;
+	}
+};
+
+/* Maps one metric onto the Software indicator color of one LED */
+struct rule {
+	uint8_t led_type;
+	metric_type metric;
+	std::string source; /* hwmon file, or interface name pattern */
+	double min, max;
+	unsigned int steps; /* distinct colors between from and to */
+	uint8_t brightness;
+	rgb from, to;
+
+	unique_fd fd; /* the hwmon file, kept open */
+	double value = 0;
+	bool shown = false; /* last is on the LED */
+	rgb last = {};
+};
+
+struct config {
+	unsigned int interval_ms = 2000;
+	std::vector<rule> rules;
+};
+
+/* Counters logged on SIGUSR1 and at exit */
+static struct {
+	unsigned long wakeups;
+	unsigned long samples;
+	unsigned long netlink_msgs;
+	unsigned long updates; /* LED color changes */
+	unsigned long ops; /* ops sent to the driver */
+} stats;
+
+static const char *device_path = "/dev/nuc_led";
+static const char *config_path = "/etc/nucledd.json";
+static bool dry_run;
+static int verbose;
+
+static void log_msg(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+static void log_msg(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fputs("nucledd: ", stderr);
+	vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+}
+
+[[noreturn]] static void config_error(size_t entry, const std::string &what)
+{
+	throw std::invalid_argument("rules[" + std::to_string(entry) +
+				    "]: " + what);
+}
+
+static double rule_number(size_t entry, const json_value &obj,
+			  const char *key, double def)
+{
+	const json_value *v = obj.get(key);
+
+	if (!v)
+		return def;
+	if (v->type != json_value::number)
+		config_error(entry, std::string(key) + " must be a number");
+	return v->n;
+}
+
+static std::string rule_string(size_t entry, const json_value &obj,
+			       const char *key, const char *def)
+{
+	const json_value *v = obj.get(key);
+
+	if (!v && def)
+		return def;
+	if (!v || v->type != json_value::string)
+		config_error(entry, std::string(key) + " must be a string");
+	return v->s;
+}
+
+static rgb parse_color(size_t entry, const json_value &obj, const char *key)
+{
+	std::string hex = rule_string(entry, obj, key, nullptr);
+	unsigned long n;
+	char *end;
+
+	n = hex.size() == 7 && hex[0] == '#' ?
+		    strtoul(hex.c_str() + 1, &end, 16) :
+		    0;
+	if (hex.size() != 7 || hex[0] != '#' || *end)
+		config_error(entry, std::string(key) +
+					    " must look like #rrggbb");
+	return { uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n) };
+}
+
+/* Number of colors a metric is spread over, from 1 to 256 */
+static unsigned int rule_steps(size_t entry, const json_value &obj)
+{
+	double steps = rule_number(entry, obj, "steps", 8);
+
+	if (steps < 1 || steps > 256 || steps != std::floor(steps))
+		config_error(entry, "steps must be a whole number from 1 to 256");
+	return steps;
+}
+
+static rule parse_rule(size_t entry, const json_value &obj)
+{
+	static const char *const metrics[] = { "cpu", "temp", "link",
+					       "route" };
+	std::string metric;
+	rule r;
+
+	if (obj.type != json_value::object)
+		config_error(entry, "must be an object");
+
+	if (!parse_led(rule_string(entry, obj, "led", nullptr), r.led_type))
+		config_error(entry, "unknown led");
+
+	metric = rule_string(entry, obj, "metric", nullptr);
+	auto m = std::find(std::begin(metrics), std::end(metrics), metric);
+	if (m == std::end(metrics))
+		config_error(entry, "unknown metric " + metric);
+	r.metric = metric_type(m - std::begin(metrics));
+
+	// Link and route metrics are 0 (down) or 1 (up)
+	switch (r.metric) {
+	case metric_cpu:
+		r.min = rule_number(entry, obj, "min", 0);
+		r.max = rule_number(entry, obj, "max", 100);
+		r.steps = rule_steps(entry, obj);
+		break;
+	case metric_temp:
+		r.source = rule_string(entry, obj, "hwmon", nullptr);
+		r.min = rule_number(entry, obj, "min", 40);
+		r.max = rule_number(entry, obj, "max", 90);
+		r.steps = rule_steps(entry, obj);
+		break;
+	case metric_link:
+	case metric_route:
+		r.source = rule_string(entry, obj, "interface", "*");
+		r.min = 0;
+		r.max = 1;
+		r.steps = 2;
+		break;
+	}
+	if (r.max <= r.min)
+		config_error(entry, "max must be above min");
+
+	r.brightness = std::clamp(rule_number(entry, obj, "brightness", 100),
+				  0.0, 100.0);
+	r.from = parse_color(entry, obj, "from");
+	r.to = parse_color(entry, obj, "to");
+	return r;
+}
+
+static config load_config(const char *path)
+{
+	std::ifstream file(path);
+	std::stringstream text;
+	const json_value *rules;
+	json_value root;
+	config c;
+
+	if (!file)
+		throw std::system_error(errno, std::generic_category(), path);
+	text << file.rdbuf();
+
+	root = parse_json(text.str());
+	c.interval_ms = rule_number(0, root, "interval_ms", c.interval_ms);
+	if (c.interval_ms < 100)
+		throw std::invalid_argument("interval_ms must be at least 100");
+
+	rules = root.get("rules");
+	if (!rules || rules->type != json_value::array)
+		throw std::invalid_argument("missing \"rules\" array");
+
+	for (size_t i = 0; i < rules->items.size(); i++) {
+		rule r = parse_rule(i, rules->items[i]);
+
+		for (auto &other : c.rules) {
+			if (other.led_type == r.led_type)
+				config_error(i, "led already has a rule");
+		}
+		if (r.metric == metric_temp) {
+			r.fd = unique_fd(
+				open(r.source.c_str(), O_RDONLY | O_CLOEXEC));
+			if (r.fd.get() < 0)
+				throw std::system_error(errno,
+							std::generic_category(),
+							r.source);
+		}
+		c.rules.push_back(std::move(r));
+	}
+	return c;
+}
+
+/* Where a metric sits between min and max, quantized to steps colors */
+static rgb rule_color(const rule &r)
+{
+	double t = std::clamp((r.value - r.min) / (r.max - r.min), 0.0, 1.0);
+
+	if (r.steps >= 2)
+		t = std::round(t * (r.steps - 1)) / (r.steps - 1);
+
+	auto mix = [t](uint8_t a, uint8_t b) {
+		return uint8_t(std::lround(a + (b - a) * t));
+	};
+	return { mix(r.from.red, r.to.red), mix(r.from.green, r.to.green),
+		 mix(r.from.blue, r.to.blue) };
+}
+
+/*
+ * Sampled metrics. Files are read with pread() on descriptors that stay
+ * open, so a wakeup costs a handful of syscalls and no allocation.
+ */
+class sampler {
+public:
+	sampler()
+	{
+		stat_fd_ = unique_fd(open("/proc/stat", O_RDONLY | O_CLOEXEC));
+		if (stat_fd_.get() < 0)
+			throw std::system_error(errno, std::generic_category(),
+						"/proc/stat");
+	}
+
+	/* Busy percentage of all CPUs since the previous call */
+	double cpu()
+	{
+		unsigned long long v[8] = {}, total = 0, idle;
+		char buf[256];
+		ssize_t len;
+
+		len = pread(stat_fd_.get(), buf, sizeof(buf) - 1, 0);
+		if (len <= 0)
+			return cpu_;
+		buf[len] = '\0';
+		if (sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6],
+			   &v[7]) < 4)
+			return cpu_;
+
+		for (auto n : v)
+			total += n;
+		idle = v[3] + v[4]; /* idle and iowait */
+		if (total > total_)
+			cpu_ = 100.0 * (1.0 - double(idle - idle_) /
+						      (total - total_));
+		total_ = total;
+		idle_ = idle;
+		return cpu_;
+	}
+
+	/* Degrees Celsius from a hwmon tempN_input file */
+	static double temp(const rule &r)
+	{
+		char buf[32];
+		ssize_t len = pread(r.fd.get(), buf, sizeof(buf) - 1, 0);
+
+		if (len <= 0)
+			return r.value;
+		buf[len] = '\0';
+		return strtol(buf, nullptr, 10) / 1000.0;
+	}
+
+private:
+	unique_fd stat_fd_;
+	unsigned long long total_ = 0, idle_ = 0;
+	double cpu_ = 0;
+};
+
+/*
+ * Link and default route state, kept up to date from rtnetlink
+ * notifications after one initial dump of each.
+ */
+class netlink_state {
+public:
+	netlink_state()
+	{
+		sockaddr_nl addr = {};
+
+		fd_ = unique_fd(socket(AF_NETLINK,
+				       SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+				       NETLINK_ROUTE));
+		if (fd_.get() < 0)
+			throw std::system_error(errno, std::generic_category(),
+						"netlink");
+		addr.nl_family = AF_NETLINK;
+		addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_ROUTE |
+				 RTMGRP_IPV6_ROUTE;
+		if (bind(fd_.get(), (sockaddr *)&addr, sizeof(addr)))
+			throw std::system_error(errno, std::generic_category(),
+						"netlink bind");
+		resync();
+	}
+
+	int fd() const { return fd_.get(); }
+
+	/* Handle what is pending, true if the state changed */
+	bool receive()
+	{
+		alignas(nlmsghdr) char buf[8192];
+		bool changed = false;
+		ssize_t len;
+
+		while ((len = recv(fd_.get(), buf, sizeof(buf), 0)) > 0) {
+			for (auto *nh = (nlmsghdr *)buf; NLMSG_OK(nh, len);
+			     nh = NLMSG_NEXT(nh, len)) {
+				stats.netlink_msgs++;
+				changed |= handle(nh);
+			}
+		}
+		// Missed notifications, start over from a dump
+		if (len < 0 && errno == ENOBUFS) {
+			resync();
+			changed = true;
+		}
+		return changed;
+	}
+
+	/* 1 if a link matching pattern is up */
+	double link_up(const std::string &pattern) const
+	{
+		for (auto &l : links_) {
+			if (l.up && !fnmatch(pattern.c_str(), l.name, 0))
+				return 1;
+		}
+		return 0;
+	}
+
+	/* 1 if a default route goes through a link matching pattern */
+	double default_route(const std::string &pattern) const
+	{
+		for (auto &r : routes_) {
+			for (auto &l : links_) {
+				if (l.index == r.oif &&
+				    !fnmatch(pattern.c_str(), l.name, 0))
+					return 1;
+			}
+		}
+		return 0;
+	}
+
+private:
+	struct iface {
+		int index;
+		bool up;
+		char name[IF_NAMESIZE];
+	};
+
+	/* A default route, the same one can be announced more than once */
+	struct route {
+		unsigned int table;
+		int family;
+		int oif;
+
+		bool operator==(const route &o) const
+		{
+			return table == o.table && family == o.family &&
+			       oif == o.oif;
+		}
+	};
+
+	unique_fd fd_;
+	int dumping_ = 0; /* RTM_GETLINK, RTM_GETROUTE or 0 */
+	std::vector<iface> links_;
+	std::vector<route> routes_;
+
+	void request_dump(int type)
+	{
+		struct {
+			nlmsghdr nh;
+			rtgenmsg gen;
+		} req = {};
+
+		req.nh.nlmsg_len = sizeof(req);
+		req.nh.nlmsg_type = type;
+		req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+		req.gen.rtgen_family = AF_UNSPEC;
+		if (send(fd_.get(), &req, sizeof(req), 0) < 0)
+			log_msg("netlink dump request failed: %s",
+			    strerror(errno));
+		dumping_ = type;
+	}
+
+	/* One dump at a time: links first, then routes */
+	void resync()
+	{
+		links_.clear();
+		routes_.clear();
+		request_dump(RTM_GETLINK);
+	}
+
+	bool handle(nlmsghdr *nh)
+	{
+		switch (nh->nlmsg_type) {
+		case NLMSG_DONE:
+		case NLMSG_ERROR:
+			if (dumping_ == RTM_GETLINK)
+				request_dump(RTM_GETROUTE);
+			else
+				dumping_ = 0;
+			return true;
+		case RTM_NEWLINK:
+		case RTM_DELLINK:
+			return handle_link(nh);
+		case RTM_NEWROUTE:
+		case RTM_DELROUTE:
+			return handle_route(nh);
+		}
+		return false;
+	}
+
+	bool handle_link(nlmsghdr *nh)
+	{
+		auto *ifi = (ifinfomsg *)NLMSG_DATA(nh);
+		int len = IFLA_PAYLOAD(nh);
+		iface l = { ifi->ifi_index,
+			   (ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) ==
+				   (IFF_UP | IFF_RUNNING),
+			   "" };
+
+		for (auto *rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFLA_IFNAME)
+				snprintf(l.name, sizeof(l.name), "%s",
+					 (char *)RTA_DATA(rta));
+		}
+
+		auto it = std::find_if(links_.begin(), links_.end(),
+				       [&](const iface &o) {
+					       return o.index == l.index;
+				       });
+		if (nh->nlmsg_type == RTM_DELLINK) {
+			if (it == links_.end())
+				return false;
+			links_.erase(it);
+		} else if (it == links_.end()) {
+			links_.push_back(l);
+		} else {
+			if (it->up == l.up && !strcmp(it->name, l.name))
+				return false;
+			*it = l;
+		}
+		return true;
+	}
+
+	bool handle_route(nlmsghdr *nh)
+	{
+		auto *rtm = (rtmsg *)NLMSG_DATA(nh);
+		int len = RTM_PAYLOAD(nh);
+		route r = { rtm->rtm_table, rtm->rtm_family, 0 };
+
+		if (rtm->rtm_dst_len || rtm->rtm_type != RTN_UNICAST)
+			return false;
+		for (auto *rta = RTM_RTA(rtm); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == RTA_OIF)
+				r.oif = *(int *)RTA_DATA(rta);
+			else if (rta->rta_type == RTA_TABLE)
+				r.table = *(unsigned int *)RTA_DATA(rta);
+		}
+		if (!r.oif)
+			return false;
+
+		auto it = std::find(routes_.begin(), routes_.end(), r);
+		if (nh->nlmsg_type == RTM_DELROUTE) {
+			if (it == routes_.end())
+				return false;
+			routes_.erase(it);
+		} else {
+			// Replaced or announced again
+			if (it != routes_.end())
+				return false;
+			routes_.push_back(r);
+		}
+		return true;
+	}
+};
+
+static void print_batch(const batch &b)
+{
+	for (auto &op : b.ops()) {
+		if (op.action == NUCLED_OP_SET_INDICATOR)
+			printf("set_indicator,%u,%u\n", op.led_type,
+			       op.indicator_option);
+		else
+			printf("set_indicator_value,%u,%u,%u,%u\n", op.led_type,
+			       op.indicator_option, op.item, op.value);
+	}
+	fflush(stdout);
+}
+
+/* Drop the rules of LEDs this NUC doesn't have */
+static void check_leds(const device &dev, config &c)
+{
+	std::vector<nuc_led_ioc_led> leds = dev.leds();
+
+	for (auto r = c.rules.begin(); r != c.rules.end();) {
+		bool found = std::any_of(leds.begin(), leds.end(),
+					 [&](const nuc_led_ioc_led &l) {
+						 return l.led_type ==
+							r->led_type;
+					 });
+
+		if (found) {
+			++r;
+			continue;
+		}
+		log_msg("no LED %s, ignoring its rule", led_name(r->led_type));
+		r = c.rules.erase(r);
+	}
+}
+
+/* Item id of a field of the Software indicator */
+static uint8_t software_item(const char *name)
+{
+	uint8_t item;
+
+	if (!parse_field(software, name, item))
+		throw std::logic_error(std::string("no software field ") + name);
+	return item;
+}
+
+/* Send the colors that changed, all in one batch */
+static void update_leds(device &dev, config &c)
+{
+	static const uint8_t brightness = software_item("brightness"),
+			     red = software_item("red"),
+			     green = software_item("green"),
+			     blue = software_item("blue");
+	std::vector<led_config> changed;
+
+	for (auto &r : c.rules) {
+		rgb color = rule_color(r);
+
+		if (r.shown && !(color != r.last))
+			continue;
+		r.last = color;
+		r.shown = true;
+		stats.updates++;
+		if (verbose)
+			log_msg("%s: %.1f -> #%02x%02x%02x", led_name(r.led_type),
+			    r.value, color.red, color.green, color.blue);
+
+		changed.push_back({ r.led_type,
+				    software,
+				    { { brightness, r.brightness },
+				      { red, color.red },
+				      { green, color.green },
+				      { blue, color.blue } } });
+	}
+	if (changed.empty())
+		return;
+
+	try {
+		batch b = diff(dev, changed);
+
+		stats.ops += b.size();
+		if (dry_run)
+			print_batch(b);
+		else if (dev.apply(b))
+			log_msg("some LED updates failed");
+	} catch (const std::exception &e) {
+		log_msg("%s", e.what());
+		// Try again on the next change
+		for (auto &r : c.rules)
+			r.shown = false;
+	}
+}
+
+static void sample(sampler &s, config &c)
+{
+	double cpu = s.cpu();
+
+	stats.samples++;
+	for (auto &r : c.rules) {
+		if (r.metric == metric_cpu)
+			r.value = cpu;
+		else if (r.metric == metric_temp)
+			r.value = sampler::temp(r);
+	}
+}
+
+static void sample_net(const netlink_state &net, config &c)
+{
+	for (auto &r : c.rules) {
+		if (r.metric == metric_link)
+			r.value = net.link_up(r.source);
+		else if (r.metric == metric_route)
+			r.value = net.default_route(r.source);
+	}
+}
+
+static void log_stats()
+{
+	rusage ru;
+	double cpu_ms;
+
+	getrusage(RUSAGE_SELF, &ru);
+	cpu_ms = ru.ru_utime.tv_sec * 1e3 + ru.ru_utime.tv_usec / 1e3 +
+		 ru.ru_stime.tv_sec * 1e3 + ru.ru_stime.tv_usec / 1e3;
+	log_msg("wakeups %lu samples %lu netlink %lu updates %lu ops %lu "
+	    "cpu %.1f ms (%.1f us per wakeup)",
+	    stats.wakeups, stats.samples, stats.netlink_msgs, stats.updates,
+	    stats.ops, cpu_ms,
+	    stats.wakeups ? cpu_ms * 1e3 / stats.wakeups : 0.0);
+}
+
+static bool needs(const config &c, std::initializer_list<metric_type> metrics)
+{
+	for (auto &r : c.rules) {
+		if (std::find(metrics.begin(), metrics.end(), r.metric) !=
+		    metrics.end())
+			return true;
+	}
+	return false;
+}
+
+/* Wake up when fd is readable */
+static void epoll_watch(int epfd, int fd)
+{
+	epoll_event ev = {};
+
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev))
+		throw std::system_error(errno, std::generic_category(),
+					"epoll_ctl");
+}
+
+/*
+ * Arm the timer only if a rule needs sampling, and open the netlink
+ * socket only if a rule needs link state, so that an idle configuration
+ * never wakes up.
+ */
+static void setup_sources(int epfd, int timer_fd, config &c,
+			  std::unique_ptr<netlink_state> &net)
+{
+	itimerspec its = {};
+
+	if (needs(c, { metric_cpu, metric_temp })) {
+		its.it_interval.tv_sec = c.interval_ms / 1000;
+		its.it_interval.tv_nsec = (c.interval_ms % 1000) * 1000000L;
+		its.it_value = its.it_interval;
+	}
+	timerfd_settime(timer_fd, 0, &its, nullptr);
+
+	if (needs(c, { metric_link, metric_route }) && !net) {
+		net = std::make_unique<netlink_state>();
+		epoll_watch(epfd, net->fd());
+	} else if (!needs(c, { metric_link, metric_route }) && net) {
+		net.reset(); /* closing the socket removes it from epoll */
+	}
+}
+
+[[noreturn]] static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: nucledd [-hnv] [-c config] [-d device]\n"
+		"\n"
+		"  -c  rules, default /etc/nucledd.json\n"
+		"  -d  device, default /dev/nuc_led\n"
+		"  -n  print the changes instead of applying them\n"
+		"  -v  log every color change\n"
+		"\n"
+		"SIGHUP reloads the rules, SIGUSR1 logs statistics.\n");
+	exit(status);
+}
+
+/* Handle one signal, false if the daemon should exit */
+static bool handle_signal(int sig_fd, int epfd, int timer_fd,
+			  const device &dev, sampler &s, config &c,
+			  std::unique_ptr<netlink_state> &net)
+{
+	signalfd_siginfo si;
+
+	if (read(sig_fd, &si, sizeof(si)) <= 0)
+		return true;
+
+	switch (si.ssi_signo) {
+	case SIGUSR1:
+		log_stats();
+		return true;
+	case SIGHUP:
+		try {
+			config fresh = load_config(config_path);
+
+			check_leds(dev, fresh);
+			c = std::move(fresh);
+			setup_sources(epfd, timer_fd, c, net);
+			sample(s, c);
+			if (net)
+				sample_net(*net, c);
+			log_msg("reloaded %s", config_path);
+		} catch (const std::exception &e) {
+			log_msg("keeping the old rules: %s", e.what());
+		}
+		return true;
+	default:
+		if (verbose)
+			log_stats();
+		return false;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::unique_ptr<netlink_state> net;
+	int opt, epfd, timer_fd, sig_fd;
+	bool running = true;
+	config c;
+	sigset_t mask;
+
+	while ((opt = getopt(argc, argv, "c:d:nvh")) != -1) {
+		switch (opt) {
+		case 'c':
+			config_path = optarg;
+			break;
+		case 'd':
+			device_path = optarg;
+			break;
+		case 'n':
+			dry_run = true;
+			break;
+		case 'v':
+			verbose++;
+			break;
+		default:
+			usage(opt == 'h' ? 0 : 2);
+		}
+	}
+	if (optind != argc)
+		usage(2);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+	sigaddset(&mask, SIGUSR1);
+	sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+	try {
+		device dev(device_path, !dry_run);
+		sampler s;
+
+		c = load_config(config_path);
+		check_leds(dev, c);
+
+		epfd = epoll_create1(EPOLL_CLOEXEC);
+		timer_fd = timerfd_create(CLOCK_MONOTONIC,
+					  TFD_NONBLOCK | TFD_CLOEXEC);
+		sig_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (epfd < 0 || timer_fd < 0 || sig_fd < 0)
+			throw std::system_error(errno, std::generic_category(),
+						"setup");
+		epoll_watch(epfd, timer_fd);
+		epoll_watch(epfd, sig_fd);
+		setup_sources(epfd, timer_fd, c, net);
+
+		// Link rules settle once the netlink dump has been received
+		sample(s, c);
+		update_leds(dev, c);
+
+		while (running) {
+			epoll_event events[4];
+			uint64_t expirations;
+			int n, i;
+
+			n = epoll_wait(epfd, events, 4, -1);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				throw std::system_error(
+					errno, std::generic_category(),
+					"epoll_wait");
+			stats.wakeups++;
+
+			for (i = 0; i < n; i++) {
+				int fd = events[i].data.fd;
+
+				if (fd == timer_fd) {
+					if (read(fd, &expirations,
+						 sizeof(expirations)) > 0)
+						sample(s, c);
+				} else if (fd == sig_fd) {
+					running = handle_signal(sig_fd, epfd,
+								timer_fd, dev, s,
+								c, net);
+				} else if (net && fd == net->fd()) {
+					if (net->receive())
+						sample_net(*net, c);
+				}
+			}
+			if (running)
+				update_leds(dev, c);
+		}
+	} catch (const std::exception &e) {
+		log_msg("%s", e.what());
+		return 1;
+	}
+
+	return 0;
+}
@@ -37,567 +37,3735 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <linux/module.h>
+#include <linux/version.h>
 #include <linux/kernel.h>
 #include <linux/types.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/acpi.h>
-#include <linux/vmalloc.h>
 #include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/ctype.h>
+#include <linux/fs.h>
+#include <linux/compat.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/leds.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/debugfs.h>
+#include <linux/kobject.h>
+#include <linux/sysfs.h>
+#include <linux/suspend.h>
+#include <linux/wait.h>
+#include <linux/poll.h>
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+#include <linux/led-class-multicolor.h>
+#endif
 
 MODULE_AUTHOR("Patrik Kullman");
 MODULE_DESCRIPTION("Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver");
 MODULE_LICENSE("GPL");
 ACPI_MODULE_NAME("NUC_LED");
 
+#include "nuc_led_layout.h"
 #include "nuc_led.h"
+#include "nuc_led_ioctl.h"
+#include "nuc_led_sim.h"
 
-LED_INFO *leds;
+#define CREATE_TRACE_POINTS
+#include "nuc_led_trace.h"
 
-static int nuc_led_get_indicator_items(u8 led_id, u8 indicator_id, u8 items,
-				       u8 *indicator)
+/*
+ * Shadow copy of the LED state. It is populated from firmware on first
+ * read (or on an explicit "refresh" command) and kept up to date by the
+ * write path, so reads are served without any WMI calls. The table is
+ * sized for every LED LED_TYPES can report and holds the indicator values
+ * inline, so keeping it up to date never allocates.
+ *
+ * nuc_led_lock protects the cache and serializes every WMI call. Readers
+ * don't take it, they use the snapshot published from the cache (see
+ * nuc_led_publish_state).
+ */
+static LED_INFO leds[NUCLED_MAX_LEDS];
+static int num_leds;
+static bool leds_cached;
+static bool leds_dirty;
+static DEFINE_MUTEX(nuc_led_lock);
+
+/*
+ * LED presence, color types and supported indicators never change, so
+ * they are discovered once. init_nuc_led() leaves that and the first read
+ * of the state to nuc_led_probe_work, so loading the module doesn't wait
+ * for firmware; readers only wait for nuc_led_probed if they come first.
+ */
+static bool nuc_led_caps_known;
+static void nuc_led_probe(struct work_struct *work);
+static DECLARE_WORK(nuc_led_probe_work, nuc_led_probe);
+static DECLARE_COMPLETION(nuc_led_probed);
+
+/*
+ * The class devices and the sysfs tree need the capabilities, so they are
+ * registered by a work item queued when those are first known, be it from
+ * the probe or from a later retry.
+ */
+static bool nuc_led_devices_registered;
+static void nuc_led_register_devices(struct work_struct *work);
+static DECLARE_WORK(nuc_led_register_work, nuc_led_register_devices);
+
+/* Read-only copy of the LED state that userspace can mmap from /dev/nuc_led */
+static struct nuc_led_shared_state *nuc_led_shared;
+
+/*
+ * WMI call statistics, per method ID. Counters are per CPU so recording
+ * them is cheap; debugfs nuc_led/wmi sums them up.
+ */
+#define NUCLED_WMI_NUM_METHODS 8
+#define NUCLED_WMI_LATENCY_BUCKETS 24 /* log2 of the latency in microseconds */
+
+static const struct {
+	u8 code;
+	const char *name;
+} nuc_led_wmi_returns[] = {
+	{ NUCLED_WMI_RETURN_SUCCESS, "success" },
+	{ NUCLED_WMI_RETURN_NOSUPPORT, "nosupport" },
+	{ NUCLED_WMI_RETURN_UNDEFINED, "undefined" },
+	{ NUCLED_WMI_RETURN_NORESPONSE, "noresponse" },
+	{ NUCLED_WMI_RETURN_BADPARAM, "badparam" },
+	{ NUCLED_WMI_RETURN_UNEXPECTED, "unexpected" },
+};
+#define NUCLED_WMI_NUM_RETURNS (ARRAY_SIZE(nuc_led_wmi_returns) + 1) /* + other */
+
+struct nuc_led_wmi_stats {
+	u64 calls;
+	u64 errors; /* evaluation failed, no return code */
+	u64 returns[NUCLED_WMI_NUM_RETURNS];
+	u64 latency[NUCLED_WMI_LATENCY_BUCKETS];
+};
+
+static DEFINE_PER_CPU(struct nuc_led_wmi_stats[NUCLED_WMI_NUM_METHODS],
+		      nuc_led_wmi_counters);
+
+static const char *const nuc_led_wmi_methods[NUCLED_WMI_NUM_METHODS] = {
+	[NUCLED_WMI_METHODID_GETSTATE] = "GETSTATE",
+	[NUCLED_WMI_METHODID_SETSTATE] = "SETSTATE",
+	[NUCLED_WMI_METHODID_QUERYLED] = "QUERYLED",
+	[NUCLED_WMI_METHODID_NEWGETLEDSTATUS] = "NEWGETLEDSTATUS",
+	[NUCLED_WMI_METHODID_SETINDICATOROPTIONLEDTYPE] =
+		"SETINDICATOROPTIONLEDTYPE",
+	[NUCLED_WMI_METHODID_SETVALUEINDICATOROPTIONLEDTYPE] =
+		"SETVALUEINDICATOROPTIONLEDTYPE",
+	[NUCLED_WMI_METHODID_APPNOTIFY] = "APPNOTIFY",
+};
+
+static void nuc_led_wmi_record(u32 method_id, int code, s64 latency_ns)
+{
+	unsigned int r, bucket = 0;
+	u64 us = latency_ns > 0 ? div_u64(latency_ns, NSEC_PER_USEC) : 0;
+
+	if (method_id >= NUCLED_WMI_NUM_METHODS)
+		return;
+
+	this_cpu_inc(nuc_led_wmi_counters[method_id].calls);
+
+	if (us)
+		bucket = min_t(unsigned int, ilog2(us) + 1,
+			       NUCLED_WMI_LATENCY_BUCKETS - 1);
+	this_cpu_inc(nuc_led_wmi_counters[method_id].latency[bucket]);
+
+	if (code < 0) {
+		this_cpu_inc(nuc_led_wmi_counters[method_id].errors);
+		return;
+	}
+
+	for (r = 0; r < ARRAY_SIZE(nuc_led_wmi_returns); r++) {
+		if (nuc_led_wmi_returns[r].code == code)
+			break;
+	}
+	this_cpu_inc(nuc_led_wmi_counters[method_id].returns[r]);
+}
+
+/*
+ * Output of the WMI methods, a buffer object of a few bytes. ACPICA
+ * copies it here instead of allocating it for every call; all calls are
+ * made with nuc_led_lock held.
+ */
+static union {
+	union acpi_object obj;
+	u8 bytes[sizeof(union acpi_object) + 32];
+} nuc_led_wmi_scratch;
+
+/* Real firmware, through the LED control WMI interface */
+static int nuc_led_wmi_backend_evaluate(u32 method_id,
+					const struct acpi_args *args,
+					u8 *reply)
+{
+	struct acpi_buffer input = { (acpi_size)sizeof(*args), (void *)args };
+	struct acpi_buffer output = { sizeof(nuc_led_wmi_scratch),
+				      &nuc_led_wmi_scratch };
+	union acpi_object *obj = &nuc_led_wmi_scratch.obj;
+	acpi_status status;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	// Per Intel docs, first instance is used (instance is indexed from 0)
+	status = wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0, method_id,
+				     &input, &output);
+	if (ACPI_FAILURE(status)) {
+		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
+		return -EIO;
+	}
+
+	if (!output.length || obj->type != ACPI_TYPE_BUFFER ||
+	    !obj->buffer.length)
+		return -EIO;
+
+	memset(reply, 0, NUCLED_WMI_REPLY_SIZE);
+	memcpy(reply, obj->buffer.pointer,
+	       min_t(u32, obj->buffer.length, NUCLED_WMI_REPLY_SIZE));
+
+	return 0;
+}
+
+static const struct nuc_led_backend nuc_led_wmi_backend = {
+	.name = "wmi",
+	.evaluate = nuc_led_wmi_backend_evaluate,
+};
+
+static const struct nuc_led_backend *nuc_led_backends[] = {
+	&nuc_led_wmi_backend,
+	&nuc_led_sim_backend,
+};
+
+/* Selected by the backend module parameter at load time */
+static const struct nuc_led_backend *nuc_led_backend = &nuc_led_wmi_backend;
+
+/*
+ * Evaluate an LED control WMI method, the only way into firmware. Fills
+ * reply (NUCLED_WMI_REPLY_SIZE bytes), whose first byte is the return
+ * code; anything but NUCLED_WMI_RETURN_SUCCESS is an error.
+ */
+static int nuc_led_wmi_evaluate(u32 method_id, struct acpi_args *args,
+				u8 *reply)
+{
+	ktime_t start;
+	s64 duration;
+	int ret, code;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	trace_nuc_led_wmi_entry(method_id, (const u8 *)args);
+	start = ktime_get();
+	ret = nuc_led_backend->evaluate(method_id, args, reply);
+	duration = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	code = ret ? -1 : reply[0];
+	nuc_led_wmi_record(method_id, code, duration);
+	trace_nuc_led_wmi_exit(method_id, ret, code, duration);
+
+	if (ret)
+		return ret;
+	if (code != NUCLED_WMI_RETURN_SUCCESS) {
+		pr_warn_ratelimited("WMI method %u failed with return code 0x%02x\n",
+				    method_id, code);
+		return -EIO;
+	}
+	return 0;
+}
+
+static int nuc_led_get_indicator_item(u8 led_id, u8 indicator_id, u8 item_id,
+				      u8 *value)
 {
 	struct acpi_args args = {
 		.arg1 = NUCLED_WMI_METHODARG_GETINDICATOROPTIONVALUE,
 		.arg2 = led_id,
 		.arg3 = indicator_id,
-		.arg4 = 0
+		.arg4 = item_id
 	};
-	struct acpi_buffer input;
-	struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
-	union acpi_object *obj;
-	acpi_status status;
-	u8 i;
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
+
+	if (nuc_led_wmi_evaluate(NUCLED_WMI_METHODID_NEWGETLEDSTATUS, &args,
+				 reply))
+		return -EIO;
+
+	*value = reply[1];
+	// pr_info("LED %i, ind id %d, item %d, val %d", led_id, indicator_id, item_id, reply[1]);
+
+	return 0;
+}
 
-	input.length = (acpi_size)sizeof(args);
-	input.pointer = &args;
+static int nuc_led_get_indicator_items(u8 led_id, u8 indicator_id, u8 items,
+				       u8 *indicator)
+{
+	u8 i;
 
 	for (i = 0; i < items; i++) {
-		args.arg4 = i;
-		status =
-			wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0,
-					    NUCLED_WMI_METHODID_NEWGETLEDSTATUS,
-					    &input, &output);
-
-		if (ACPI_FAILURE(status)) {
-			ACPI_EXCEPTION(
-				(AE_INFO, status, "wmi_evaluate_method"));
+		if (nuc_led_get_indicator_item(led_id, indicator_id, i,
+					       &indicator[i]))
 			return -EIO;
-		}
-
-		// Always returns a buffer
-		obj = (union acpi_object *)output.pointer;
-		indicator[i] = obj->buffer.pointer[1];
-		// pr_info("LED %i, ind id %d, item %d, val %d", led_id, indicator_id, i, obj->buffer.pointer[1]);
 	}
 
-	kfree(obj);
-
 	return 0;
 }
 
+static const struct nuc_led_indicator_layout *
+nuc_led_indicator_layout(u8 indicator_option)
+{
+	if (indicator_option >= ARRAY_SIZE(nuc_led_indicator_layouts))
+		return NULL;
+	return &nuc_led_indicator_layouts[indicator_option];
+}
+
+static const char *nuc_led_indicator_name(u8 indicator_option)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(indicator_option);
+
+	if (indicator_option == NUCLED_USAGE_TYPE_DISABLE)
+		return "disable";
+	return layout ? layout->name : NULL;
+}
+
+/* Size in bytes (= number of items) of an indicator's option values */
+static int nuc_led_indicator_size(u8 indicator_option)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(indicator_option);
+
+	return layout ? layout->size : 0;
+}
+
 static int nuc_led_fill_indicator_values(LED_INFO *led)
 {
-	int ssize;
-	switch (led->indicator_option) {
-	case NUCLED_USAGE_TYPE_POWER_STATE:
-		ssize = sizeof(struct power_state_indicator);
-		break;
-	case NUCLED_USAGE_TYPE_HDD_ACTIVITY:
-		ssize = sizeof(struct hdd_activity_indicator);
-		break;
-	case NUCLED_USAGE_TYPE_ETHERNET:
-		ssize = sizeof(struct ethernet_indicator);
-		break;
-	case NUCLED_USAGE_TYPE_WIFI:
-		ssize = sizeof(struct wifi_indicator);
-		break;
-	case NUCLED_USAGE_TYPE_SOFTWARE:
-		ssize = sizeof(struct software_indicator);
-		break;
-	case NUCLED_USAGE_TYPE_POWER_LIMIT:
-		ssize = sizeof(struct power_limit_indicator);
-		break;
-	default:
-		pr_warn("Unexpected indicator option %d\n",
-			led->indicator_option);
+	int ssize = nuc_led_indicator_size(led->indicator_option);
+	int ret;
+
+	led->indicator_valid = false;
+	memset(&led->indicator, 0, sizeof(led->indicator));
+
+	if (!ssize) {
+		if (led->indicator_option != NUCLED_USAGE_TYPE_DISABLE)
+			pr_warn("Unexpected indicator option %d\n",
+				led->indicator_option);
 		return 0;
 	}
-	led->indicator = vmalloc(ssize);
-	return nuc_led_get_indicator_items(led->led_type, led->indicator_option,
-					   ssize, led->indicator);
+	ret = nuc_led_get_indicator_items(led->led_type, led->indicator_option,
+					  ssize, led->indicator.raw);
+	led->indicator_valid = !ret;
+	return ret;
 }
 
-/* Get LED */
-static int nuc_led_get_led(u8 led_id, LED_INFO *led)
+/* Get the static capabilities of an LED: color type and supported indicators */
+static int nuc_led_get_led_caps(u8 led_id, LED_INFO *led)
 {
 	struct acpi_args args = {
 		.arg1 = NUCLED_WMI_METHODARG_QUERYLEDCOLORTYPE, .arg2 = led_id
 	};
-	struct acpi_buffer input;
-	struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
-	union acpi_object *obj;
-	acpi_status status;
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
 
-	input.length = (acpi_size)sizeof(args);
-	input.pointer = &args;
+	if (nuc_led_wmi_evaluate(NUCLED_WMI_METHODID_QUERYLED, &args, reply))
+		return -EIO;
 
-	// Per Intel docs, first instance is used (instance is indexed from 0)
-	status = wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0,
-				     NUCLED_WMI_METHODID_QUERYLED, &input,
-				     &output);
+	led->led_type = led_id;
+	led->name = led_names[led_id];
+	led->led_color_type.flags = reply[1];
 
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
+	// pr_info("LED %i (%s) - Color type blue_amber %i, blue_white %i, rgb %i", led_id, led->name, led->led_color_type.blue_amber, led->led_color_type.blue_white, led->led_color_type.rgb);
+
+	args.arg1 = NUCLED_WMI_METHODARG_QUERYINDICATORSUPPORT;
+
+	if (nuc_led_wmi_evaluate(NUCLED_WMI_METHODID_QUERYLED, &args, reply))
+		return -EIO;
+
+	led->usage_type = reply[1];
+
+	// pr_info("LED %i - Got power_state %i, hdd_activity %i, ethernet %i, wifi %i, software %i, power_limit %i, disable %i", led_id, led->usage_type.power_state, led->usage_type.hdd_activity, led->usage_type.ethernet, led->usage_type.wifi, led->usage_type.software, led->usage_type.power_limit, led->usage_type.disable);
+
+	return 0;
+}
+
+/* Get the current indicator of an LED */
+static int nuc_led_get_current_indicator(u8 led_id, u8 *indicator_id)
+{
+	struct acpi_args args = {
+		.arg1 = NUCLED_WMI_METHODARG_GETCURRENTINDICATOR,
+		.arg2 = led_id
+	};
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
+
+	if (nuc_led_wmi_evaluate(NUCLED_WMI_METHODID_NEWGETLEDSTATUS, &args,
+				 reply))
+		return -EIO;
+
+	*indicator_id = reply[1];
+
+	// pr_info("LED %i - Got indicator option %i", led_id, reply[1]);
+
+	return 0;
+}
+
+/* Get the current indicator of an LED and its values */
+static int nuc_led_get_led_state(LED_INFO *led)
+{
+	led->others_valid = 0;
+	if (nuc_led_get_current_indicator(led->led_type,
+					  &led->indicator_option))
+		return -EIO;
+
+	return nuc_led_fill_indicator_values(led);
+}
+
+/* Forget everything about the LEDs, capabilities included */
+static void nuc_led_clear_leds(void)
+{
+	memset(leds, 0, sizeof(leds));
+	num_leds = 0;
+	nuc_led_caps_known = false;
+	leds_cached = false;
+	leds_dirty = true;
+}
+
+/* Discover which LEDs there are and what they support */
+static int nuc_led_get_caps(void)
+{
+	struct acpi_args args = { .arg1 = 0 };
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
+
+	LED_TYPES led_types;
+	int flags, i, o = 0;
+
+	if (nuc_led_wmi_evaluate(NUCLED_WMI_METHODID_QUERYLED, &args, reply))
 		return -EIO;
+
+	flags = led_types.flags = reply[1];
+
+	// pr_info("Got pwr %i, hdd %i, skull %i, eyes %i, front1 %i, front2 %i, front3 %i", led_types.power, led_types.hdd, led_types.skull, led_types.eyes, led_types.front1, led_types.front2, led_types.front3);
+
+	nuc_led_clear_leds();
+
+	num_leds = countSetBits(led_types.flags);
+	// pr_info("Num leds: %i", num_leds);
+
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		if ((flags & 0x01) && nuc_led_get_led_caps(i, &leds[o++])) {
+			// Don't remember partial capabilities, probe again
+			nuc_led_clear_leds();
+			return -EIO;
+		}
+		flags = flags >> 1;
+	}
+
+	nuc_led_caps_known = true;
+	schedule_work(&nuc_led_register_work);
+	return 0;
+}
+
+/*
+ * Get LEDs. Capabilities are only queried the first time, after that
+ * just the current indicators and their values are read again.
+ */
+static int nuc_led_get_leds(void)
+{
+	int i, ret;
+
+	if (!nuc_led_caps_known) {
+		ret = nuc_led_get_caps();
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < num_leds; i++) {
+		ret = nuc_led_get_led_state(&leds[i]);
+		if (ret) {
+			// Don't serve a partial read as the current state
+			leds_cached = false;
+			return ret;
+		}
+	}
+
+	leds_cached = true;
+	leds_dirty = true;
+
+	return num_leds;
+}
+
+/* Populate the LED cache from firmware unless it already is. */
+static int nuc_led_get_cached_leds(void)
+{
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (leds_cached) {
+		trace_nuc_led_cache_hit(NUCLED_NO_ITEM, NUCLED_NO_ITEM,
+					NUCLED_NO_ITEM);
+		return num_leds;
+	}
+
+	trace_nuc_led_cache_miss(NUCLED_NO_ITEM, NUCLED_NO_ITEM,
+				 NUCLED_NO_ITEM);
+	return nuc_led_get_leds();
+}
+
+static LED_INFO *nuc_led_find_cached_led(u8 led_id)
+{
+	int i;
+
+	if (!leds_cached)
+		return NULL;
+
+	for (i = 0; i < num_leds; i++) {
+		if (leds[i].led_type == led_id)
+			return &leds[i];
+	}
+	return NULL;
+}
+
+/* Keep the cache in sync after a successful set_indicator */
+static void nuc_led_cache_indicator(u8 led_id, u8 indicator_id)
+{
+	LED_INFO *led = nuc_led_find_cached_led(led_id);
+
+	if (!led || led->indicator_option == indicator_id)
+		return;
+
+	if (led->indicator_valid &&
+	    led->indicator_option < NUCLED_USAGE_TYPE_DISABLE) {
+		led->others[led->indicator_option] = led->indicator;
+		led->others_valid |= BIT(led->indicator_option);
+	}
+
+	led->indicator_option = indicator_id;
+	if (led->others_valid & BIT(indicator_id)) {
+		led->indicator = led->others[indicator_id];
+		led->indicator_valid = true;
+		led->others_valid &= ~BIT(indicator_id);
+	} else if (nuc_led_fill_indicator_values(led)) {
+		leds_cached = false;
+	}
+	leds_dirty = true;
+}
+
+/* Keep the cache in sync after a successful set_indicator_value */
+static void nuc_led_cache_indicator_option(u8 led_id, u8 indicator_id,
+					   u8 item_id, u8 value)
+{
+	LED_INFO *led = nuc_led_find_cached_led(led_id);
+
+	if (!led || item_id >= nuc_led_indicator_size(indicator_id))
+		return;
+
+	if (led->indicator_option != indicator_id) {
+		if (led->others_valid & BIT(indicator_id))
+			led->others[indicator_id].raw[item_id] = value;
+		return;
+	}
+
+	if (led->indicator_valid && led->indicator.raw[item_id] != value) {
+		led->indicator.raw[item_id] = value;
+		leds_dirty = true;
+	}
+}
+
+/* Look up the last known value of an item, if it is cached */
+static bool nuc_led_cached_item(u8 led_id, u8 indicator_id, u8 item_id,
+				u8 *value)
+{
+	LED_INFO *led = nuc_led_find_cached_led(led_id);
+
+	if (!led || item_id >= nuc_led_indicator_size(indicator_id))
+		return false;
+
+	if (led->indicator_option == indicator_id && led->indicator_valid)
+		*value = led->indicator.raw[item_id];
+	else if (led->others_valid & BIT(indicator_id))
+		*value = led->others[indicator_id].raw[item_id];
+	else
+		return false;
+	return true;
+}
+
+/* Cache the values of an indicator that isn't the current one */
+static int nuc_led_cache_other_indicator(u8 led_id, u8 indicator_id)
+{
+	LED_INFO *led = nuc_led_find_cached_led(led_id);
+	int size = nuc_led_indicator_size(indicator_id);
+	int ret;
+
+	if (!led || !size)
+		return -ENODATA;
+	if (led->indicator_option == indicator_id ||
+	    led->others_valid & BIT(indicator_id))
+		return 0;
+
+	ret = nuc_led_get_indicator_items(led_id, indicator_id, size,
+					  led->others[indicator_id].raw);
+	if (!ret)
+		led->others_valid |= BIT(indicator_id);
+	return ret;
+}
+
+static int nuc_led_set_indicator(u8 led_id, u8 indicator_id)
+{
+	struct acpi_args args = { .arg1 = led_id, .arg2 = indicator_id };
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
+
+	return nuc_led_wmi_evaluate(
+		NUCLED_WMI_METHODID_SETINDICATOROPTIONLEDTYPE, &args, reply);
+}
+
+static int nuc_led_set_indicator_option(u8 led_id, u8 indicator_id, u8 item_id,
+					u8 value)
+{
+	struct acpi_args args = { .arg1 = led_id,
+				  .arg2 = indicator_id,
+				  .arg3 = item_id,
+				  .arg4 = value };
+	u8 reply[NUCLED_WMI_REPLY_SIZE];
+
+	return nuc_led_wmi_evaluate(
+		NUCLED_WMI_METHODID_SETVALUEINDICATOROPTIONLEDTYPE, &args,
+		reply);
+}
+
+static void nuc_led_fill_ioc_led(struct nuc_led_ioc_led *out, LED_INFO *led)
+{
+	out->led_type = led->led_type;
+	out->color_type = led->led_color_type.flags;
+	out->usage_type = led->usage_type;
+	out->indicator_option = led->indicator_option;
+	if (led->indicator_valid) {
+		out->indicator_size =
+			nuc_led_indicator_size(led->indicator_option);
+		memcpy(out->indicator, led->indicator.raw, out->indicator_size);
+	}
+}
+
+/*
+ * Readers never take nuc_led_lock. Whenever a lock holder changed the
+ * cache, unlocking publishes an immutable copy of it through RCU. NULL
+ * until the cache is first populated and after it is dropped.
+ *
+ * Copies are recycled from a ring rather than allocated: a retired copy
+ * is only overwritten once the grace period that started when it was
+ * retired is over, which it normally is by the time the ring comes round.
+ * Publishing never waits for one under the lock; when the next copy is
+ * still in use, a copy is allocated instead and freed with kfree_rcu().
+ */
+struct nuc_led_snapshot {
+	u64 generation; /* 0 if it was never published */
+	u32 num_leds;
+	bool allocated; /* not from the ring */
+	struct rcu_head rcu;
+	struct nuc_led_ioc_led leds[NUCLED_MAX_LEDS];
+};
+
+#define NUCLED_SNAPSHOTS 4
+
+static struct nuc_led_snapshot nuc_led_snapshots[NUCLED_SNAPSHOTS];
+static unsigned long nuc_led_snapshot_retired[NUCLED_SNAPSHOTS];
+static unsigned int nuc_led_snapshot_next;
+static u64 nuc_led_snapshot_allocs;
+static void nuc_led_publish_retry(struct work_struct *work);
+static DECLARE_WORK(nuc_led_publish_work, nuc_led_publish_retry);
+static struct nuc_led_snapshot __rcu *nuc_led_snapshot;
+static u64 nuc_led_generation;
+
+/*
+ * Watchers of /proc/acpi/nuc_led and /dev/nuc_led sleep here until the
+ * generation moves past the one they saw, see nuc_led_poll_generation().
+ */
+static DECLARE_WAIT_QUEUE_HEAD(nuc_led_wait);
+
+/*
+ * LEDs that changed since the last change uevent. Uevents are sent by a
+ * delayed work item, at most once every NUCLED_UEVENT_INTERVAL_MS, so an
+ * animation doesn't flood udev. Protected by nuc_led_lock.
+ */
+#define NUCLED_UEVENT_INTERVAL_MS 100
+
+static unsigned long nuc_led_uevent_leds;
+static bool nuc_led_uevents_on; /* while /dev/nuc_led is registered */
+static atomic64_t nuc_led_uevents_sent = ATOMIC64_INIT(0);
+static void nuc_led_send_uevents(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nuc_led_uevent_work, nuc_led_send_uevents);
+
+/* Times a caller had to wait for nuc_led_lock */
+static atomic64_t nuc_led_lock_contended = ATOMIC64_INIT(0);
+
+/*
+ * Copy a snapshot to the shared page. Readers follow the seqcount
+ * protocol documented in nuc_led_ioctl.h: the sequence is odd while
+ * the page is being updated.
+ */
+static void nuc_led_publish_page(struct nuc_led_snapshot *snap)
+{
+	struct nuc_led_shared_state *state = nuc_led_shared;
+
+	if (!state)
+		return;
+
+	WRITE_ONCE(state->sequence, state->sequence + 1);
+	smp_wmb();
+
+	memset(state->leds, 0, sizeof(state->leds));
+	state->generation = snap ? snap->generation : 0;
+	if (snap) {
+		state->num_leds = snap->num_leds;
+		memcpy(state->leds, snap->leds,
+		       snap->num_leds * sizeof(state->leds[0]));
+	} else {
+		state->num_leds = 0;
+	}
+
+	smp_wmb();
+	WRITE_ONCE(state->sequence, state->sequence + 1);
+}
+
+/* Bitmask (1 << led_type) of the LEDs that differ, none without old state */
+static unsigned long nuc_led_changed_leds(struct nuc_led_snapshot *old,
+					  struct nuc_led_snapshot *snap)
+{
+	unsigned long changed = 0;
+	int i;
+
+	for (i = 0; old && i < snap->num_leds; i++) {
+		if (i >= old->num_leds ||
+		    memcmp(&old->leds[i], &snap->leds[i], sizeof(snap->leds[i])))
+			changed |= BIT(snap->leds[i].led_type);
+	}
+	return changed;
+}
+
+/* The next copy from the ring, or NULL if readers may still see it */
+static struct nuc_led_snapshot *nuc_led_snapshot_from_ring(void)
+{
+	unsigned int slot = nuc_led_snapshot_next;
+	struct nuc_led_snapshot *snap = &nuc_led_snapshots[slot];
+
+	if (snap->generation &&
+	    (snap == rcu_access_pointer(nuc_led_snapshot) ||
+	     !poll_state_synchronize_rcu(nuc_led_snapshot_retired[slot])))
+		return NULL;
+
+	nuc_led_snapshot_next = (slot + 1) % NUCLED_SNAPSHOTS;
+	return snap;
+}
+
+/*
+ * Replace the published snapshot with the current cache contents. Fails
+ * only if no copy could be had, nuc_led_publish_work then tries again.
+ */
+static int nuc_led_publish_state(void)
+{
+	struct nuc_led_snapshot *snap = NULL, *old;
+	bool allocated;
+	int i;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	old = rcu_dereference_protected(nuc_led_snapshot,
+					lockdep_is_held(&nuc_led_lock));
+
+	if (leds_cached) {
+		snap = nuc_led_snapshot_from_ring();
+		allocated = !snap;
+		if (allocated) {
+			snap = kmalloc(sizeof(*snap), GFP_KERNEL);
+			if (!snap) {
+				schedule_work(&nuc_led_publish_work);
+				return -ENOMEM;
+			}
+			nuc_led_snapshot_allocs++;
+		}
+
+		memset(snap, 0, sizeof(*snap));
+		snap->allocated = allocated;
+		snap->generation = nuc_led_generation + 1;
+		snap->num_leds = min(num_leds, NUCLED_MAX_LEDS);
+		for (i = 0; i < snap->num_leds; i++)
+			nuc_led_fill_ioc_led(&snap->leds[i], &leds[i]);
+		WRITE_ONCE(nuc_led_generation, snap->generation);
+
+		nuc_led_uevent_leds |= nuc_led_changed_leds(old, snap);
+		if (nuc_led_uevent_leds && nuc_led_uevents_on)
+			schedule_delayed_work(
+				&nuc_led_uevent_work,
+				msecs_to_jiffies(NUCLED_UEVENT_INTERVAL_MS));
+	}
+
+	rcu_assign_pointer(nuc_led_snapshot, snap);
+	if (old && old->allocated)
+		kfree_rcu(old, rcu);
+	else if (old)
+		nuc_led_snapshot_retired[old - nuc_led_snapshots] =
+			get_state_synchronize_rcu();
+
+	nuc_led_publish_page(snap);
+	wake_up_interruptible(&nuc_led_wait);
+	return 0;
+}
+
+static void nuc_led_state_lock(void)
+{
+	if (mutex_trylock(&nuc_led_lock))
+		return;
+
+	atomic64_inc(&nuc_led_lock_contended);
+	mutex_lock(&nuc_led_lock);
+}
+
+/* Drop the lock, publishing whatever the holder changed in one go */
+static void nuc_led_state_unlock(void)
+{
+	if (leds_dirty && !nuc_led_publish_state())
+		leds_dirty = false;
+	mutex_unlock(&nuc_led_lock);
+}
+
+/* Publish what couldn't be, once the ring's copies are out of use */
+static void nuc_led_publish_retry(struct work_struct *work)
+{
+	synchronize_rcu();
+	nuc_led_state_lock();
+	nuc_led_state_unlock();
+}
+
+/*
+ * Make sure a snapshot is published, waiting for the probe if it is still
+ * running. Readers then use nuc_led_snapshot under rcu_read_lock().
+ */
+static int nuc_led_populate(void)
+{
+	int ret;
+
+	if (rcu_access_pointer(nuc_led_snapshot))
+		return 0;
+
+	ret = wait_for_completion_killable(&nuc_led_probed);
+	if (ret)
+		return ret;
+
+	// The probe failed or the cache was dropped since, try again
+	nuc_led_state_lock();
+	ret = nuc_led_get_cached_leds();
+	nuc_led_state_unlock();
+
+	return ret < 0 ? ret : 0;
+}
+
+static const struct {
+	const char *name;
+	u8 action;
+	u8 min_args; /* including LED and indicator ids */
+	u8 max_args;
+	bool named; /* the first argument is a preset name */
+} nuc_led_actions[] = {
+	{ "set_indicator", NUCLED_PROC_SET_INDICATOR, 2, 2 },
+	{ "set_indicator_value", NUCLED_PROC_SETINDICATOROPTIONVALUE, 4, 4 },
+	{ "refresh", NUCLED_PROC_REFRESH, 0, 0 },
+	{ "set_color", NUCLED_PROC_SET_COLOR, 6, 7 },
+	{ "set_blink", NUCLED_PROC_SET_BLINK, 4, 5 },
+	{ "set_led", NUCLED_PROC_SET_LED, 8, 9 },
+	{ "preset_add", NUCLED_PROC_PRESET_ADD, 2, 4, true },
+	{ "preset_clear", NUCLED_PROC_PRESET_CLEAR, 0, 0, true },
+	{ "apply_preset", NUCLED_PROC_APPLY_PRESET, 0, 0, true },
+	{ "set_hsv", NUCLED_PROC_SET_HSV, 5, 6 },
+};
+
+/* Preset names are short identifiers, so they can't be confused with ids */
+static int nuc_led_parse_preset_name(const char *arg, int line, char *name)
+{
+	const char *c;
+
+	if (!arg || !*arg || strlen(arg) >= NUCLED_PRESET_NAME_LEN ||
+	    isdigit(*arg))
+		goto invalid;
+	for (c = arg; *c; c++) {
+		if (!isalnum(*c) && *c != '_' && *c != '-')
+			goto invalid;
+	}
+	strscpy(name, arg, NUCLED_PRESET_NAME_LEN);
+	return 0;
+
+invalid:
+	pr_warn("Invalid preset name (%s) on line %d while setting NUC LED state\n",
+		arg ? arg : "", line);
+	return -EINVAL;
+}
+
+/*
+ * Check that the color slot addressed by a composite command exists in
+ * the indicator's layout. The optional last argument selects the slot
+ * (the power state for the Power state indicator) and defaults to 0.
+ */
+static int nuc_led_validate_color_cmd(struct nuc_led_cmd *cmd, u8 slot_arg,
+				      bool blink)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(cmd->indicator_id);
+	u8 slot = cmd->num_args > slot_arg ? cmd->args[slot_arg] : 0;
+
+	if (!layout || !layout->num_colors) {
+		pr_warn("Indicator %d on line %d has no color settings\n",
+			cmd->indicator_id, cmd->line);
+		return -EINVAL;
+	}
+
+	if (slot >= layout->num_colors) {
+		pr_warn("Invalid color slot (%d) for indicator %d on line %d while setting NUC LED state\n",
+			slot, cmd->indicator_id, cmd->line);
+		return -EINVAL;
+	}
+
+	if (blink && layout->colors[slot].blink_behavior == NUCLED_NO_ITEM) {
+		pr_warn("Indicator %d on line %d has no blink settings\n",
+			cmd->indicator_id, cmd->line);
+		return -EINVAL;
+	}
+
+	cmd->args[slot_arg] = slot;
+	return 0;
+}
+
+/* Parse one "<action>,<led id>,<indicator id>[,args...]" line */
+static int nuc_led_parse_cmd(char *input, int line, struct nuc_led_cmd *cmd)
+{
+	int i = 0, a, err;
+	char *arg, *sep;
+	u8 value;
+
+	cmd->line = line;
+
+	// First arg: operation
+	sep = input;
+	arg = strsep(&sep, ",");
+	for (a = 0; a < ARRAY_SIZE(nuc_led_actions); a++) {
+		if (!strcmp(arg, nuc_led_actions[a].name))
+			break;
+	}
+	if (a == ARRAY_SIZE(nuc_led_actions)) {
+		pr_warn("Invalid action (%s) on line %d while setting NUC LED state\n",
+			arg, line);
+		return -EINVAL;
+	}
+	cmd->action = nuc_led_actions[a].action;
+
+	if (nuc_led_actions[a].named &&
+	    nuc_led_parse_preset_name(strsep(&sep, ","), line, cmd->name))
+		return -EINVAL;
+
+	// Remaining args: LED ID, indicator ID and action specific values
+	while ((arg = strsep(&sep, ",")) && *arg) {
+		if (i >= nuc_led_actions[a].max_args) {
+			pr_warn("Too many arguments for action %s on line %d while setting NUC LED state\n",
+				nuc_led_actions[a].name, line);
+			return -EOVERFLOW;
+		}
+
+		// The hue of set_hsv is in degrees, it doesn't fit args
+		if (cmd->action == NUCLED_PROC_SET_HSV && i == 2)
+			err = kstrtou16(arg, 0, &cmd->hue) || cmd->hue > 359;
+		else
+			err = kstrtou8(arg, 0, &value);
+		if (err) {
+			pr_warn("Invalid argument %d (%s) on line %d while setting NUC LED state\n",
+				i + 1, arg, line);
+			return -EINVAL;
+		}
+
+		if (i == 0)
+			cmd->led_id = value;
+		else if (i == 1)
+			cmd->indicator_id = value;
+		else
+			cmd->args[i - 2] = value;
+
+		// Track iterations
+		i++;
+	}
+
+	if (i < nuc_led_actions[a].min_args) {
+		pr_warn("Too few arguments (%d), needs %d, on line %d while setting NUC LED indicator\n",
+			i, nuc_led_actions[a].min_args, line);
+		return -EINVAL;
+	}
+	cmd->num_args = i > 2 ? i - 2 : 0;
+
+	// preset_add takes set_indicator or set_indicator_value arguments
+	if (cmd->action == NUCLED_PROC_PRESET_ADD && cmd->num_args == 1) {
+		pr_warn("Too few arguments for action preset_add on line %d while setting NUC LED state\n",
+			line);
+		return -EINVAL;
+	}
+
+	switch (cmd->action) {
+	case NUCLED_PROC_SET_COLOR: // brightness,r,g,b[,slot]
+		return nuc_led_validate_color_cmd(cmd, 4, false);
+	case NUCLED_PROC_SET_BLINK: // behavior,freq[,slot]
+		return nuc_led_validate_color_cmd(cmd, 2, true);
+	case NUCLED_PROC_SET_LED: // brightness,behavior,freq,r,g,b[,slot]
+		return nuc_led_validate_color_cmd(cmd, 6, true);
+	case NUCLED_PROC_SET_HSV: // hue,saturation,value[,slot]
+		if (cmd->args[1] > 100 || cmd->args[2] > 100) {
+			pr_warn("Saturation and value must be 0-100 on line %d while setting NUC LED state\n",
+				line);
+			return -EINVAL;
+		}
+		return nuc_led_validate_color_cmd(cmd, 3, false);
+	}
+
+	return 0;
+}
+
+/*
+ * LEDs written since the last resume, see nuc_led_pm_restore(). led_id
+ * comes from userspace, IDs the driver doesn't know aren't restored anyway.
+ */
+static unsigned long nuc_led_pm_written;
+
+/* Set an LED's indicator in firmware and in the cache */
+static int nuc_led_fw_set_indicator(u8 led_id, u8 indicator_id)
+{
+	int ret;
+
+	pr_debug("Setting LED %i indicator to %i\n", led_id, indicator_id);
+	ret = nuc_led_set_indicator(led_id, indicator_id);
+	if (!ret) {
+		nuc_led_cache_indicator(led_id, indicator_id);
+		if (led_id < NUCLED_MAX_LEDS)
+			nuc_led_pm_written |= BIT(led_id);
+	}
+	return ret;
+}
+
+/* Set an indicator item in firmware and in the cache */
+static int nuc_led_fw_set_item(u8 led_id, u8 indicator_id, u8 item_id,
+			       u8 value)
+{
+	int ret;
+
+	pr_debug("Setting LED %i indicator %i option %i to %i\n", led_id,
+		 indicator_id, item_id, value);
+	ret = nuc_led_set_indicator_option(led_id, indicator_id, item_id,
+					   value);
+	if (!ret) {
+		nuc_led_cache_indicator_option(led_id, indicator_id, item_id,
+					       value);
+		if (led_id < NUCLED_MAX_LEDS)
+			nuc_led_pm_written |= BIT(led_id);
+	}
+	return ret;
+}
+
+/*
+ * Asynchronous writes (async_writes=1). Every target (LED indicator, or
+ * LED indicator item) has one pending slot. Queued slots are drained in
+ * order by a single worker; a newer value for a slot that is still queued
+ * replaces the older one. Protected by nuc_led_lock, which the worker
+ * only holds for one firmware call at a time.
+ *
+ * Writes that exceed an LED's rate limit (max_hz) take the same path,
+ * whether async_writes is set or not: they wait in their slot until the
+ * LED's token bucket refills, so only the latest value is sent.
+ */
+struct nuc_led_pending_op {
+	struct list_head list;
+	bool queued;
+	bool throttled; /* queued because of the rate limit */
+	u8 action; /* NUCLED_PROC_SET_INDICATOR or _SETINDICATOROPTIONVALUE */
+	u8 led_id;
+	u8 indicator_id;
+	u8 item_id;
+	u8 value;
+};
+
+/* Indicators that have option values */
+#define NUCLED_NUM_INDICATORS ARRAY_SIZE(nuc_led_indicator_layouts)
+
+static struct nuc_led_pending_op nuc_led_pending_indicators[NUCLED_MAX_LEDS];
+static struct nuc_led_pending_op
+	nuc_led_pending_items[NUCLED_MAX_LEDS][NUCLED_NUM_INDICATORS]
+			     [NUCLED_MAX_INDICATOR_SIZE];
+static LIST_HEAD(nuc_led_pending_list);
+
+static struct {
+	u64 submitted;
+	u64 coalesced;
+	u64 executed;
+	u64 failed;
+	u64 deferred; /* held back by the rate limit */
+	u64 dropped; /* replaced while held back */
+} nuc_led_queue_stats;
+
+static void nuc_led_queue_drain(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nuc_led_queue_work, nuc_led_queue_drain);
+
+/* Set while unloading: drain the queue regardless of rate limits */
+static bool nuc_led_queue_flushing;
+
+/*
+ * Per-LED token bucket. Credit is kept in nanoseconds: one firmware write
+ * costs NSEC_PER_SEC / max_hz, and at most max_burst writes worth of
+ * credit accumulate while an LED is idle.
+ */
+static struct nuc_led_bucket {
+	ktime_t last;
+	u64 credit;
+} nuc_led_buckets[NUCLED_MAX_LEDS];
+
+/*
+ * Take a token for one firmware write to led_id. Otherwise return false
+ * and the time in nanoseconds until the next token is available.
+ */
+static bool nuc_led_take_token(u8 led_id, u64 *wait_ns)
+{
+	unsigned int hz = READ_ONCE(max_hz);
+	struct nuc_led_bucket *bucket;
+	u64 cost, limit, elapsed;
+	ktime_t now;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (!hz || nuc_led_queue_flushing || led_id >= NUCLED_MAX_LEDS)
+		return true;
+
+	bucket = &nuc_led_buckets[led_id];
+	now = ktime_get();
+	cost = div_u64(NSEC_PER_SEC, hz);
+	limit = cost * max(READ_ONCE(max_burst), 1u);
+
+	elapsed = ktime_to_ns(ktime_sub(now, bucket->last));
+	bucket->credit = min(bucket->credit + elapsed, limit);
+	bucket->last = now;
+
+	if (bucket->credit >= cost) {
+		bucket->credit -= cost;
+		return true;
+	}
+	*wait_ns = cost - bucket->credit;
+	return false;
+}
+
+static struct nuc_led_pending_op *nuc_led_pending_slot(u8 action, u8 led_id,
+						       u8 indicator_id,
+						       u8 item_id)
+{
+	if (led_id >= NUCLED_MAX_LEDS)
+		return NULL;
+
+	if (action == NUCLED_PROC_SET_INDICATOR)
+		return &nuc_led_pending_indicators[led_id];
+
+	if (item_id >= nuc_led_indicator_size(indicator_id))
+		return NULL;
+	return &nuc_led_pending_items[led_id][indicator_id][item_id];
+}
+
+static void nuc_led_queue_op(struct nuc_led_pending_op *slot, u8 action,
+			     u8 led_id, u8 indicator_id, u8 item_id, u8 value,
+			     bool throttled)
+{
+	lockdep_assert_held(&nuc_led_lock);
+
+	nuc_led_queue_stats.submitted++;
+	if (slot->queued) {
+		nuc_led_queue_stats.coalesced++;
+		if (slot->throttled)
+			nuc_led_queue_stats.dropped++;
+	} else {
+		list_add_tail(&slot->list, &nuc_led_pending_list);
+		slot->queued = true;
+		slot->throttled = throttled;
+	}
+
+	slot->action = action;
+	slot->led_id = led_id;
+	slot->indicator_id = indicator_id;
+	slot->item_id = item_id;
+	slot->value = value;
+
+	if (!throttled)
+		mod_delayed_work(system_wq, &nuc_led_queue_work, 0);
+}
+
+/* Queue a synchronous write that its LED's rate limit holds back */
+static void nuc_led_defer_op(struct nuc_led_pending_op *slot, u8 action,
+			     u8 led_id, u8 indicator_id, u8 item_id, u8 value,
+			     u64 wait_ns)
+{
+	nuc_led_queue_op(slot, action, led_id, indicator_id, item_id, value,
+			 true);
+	nuc_led_queue_stats.deferred++;
+
+	// Does not postpone a run that is already due sooner
+	queue_delayed_work(system_wq, &nuc_led_queue_work,
+			   nsecs_to_jiffies(wait_ns) + 1);
+}
+
+/*
+ * First queued write whose LED has a token left. Otherwise NULL, with
+ * *wait_ns set to the time until one of them gets a token.
+ */
+static struct nuc_led_pending_op *nuc_led_next_op(u64 *wait_ns)
+{
+	struct nuc_led_pending_op *slot;
+	u64 wait;
+
+	*wait_ns = U64_MAX;
+	list_for_each_entry(slot, &nuc_led_pending_list, list) {
+		if (nuc_led_take_token(slot->led_id, &wait))
+			return slot;
+		*wait_ns = min(*wait_ns, wait);
+	}
+	return NULL;
+}
+
+static void nuc_led_queue_drain(struct work_struct *work)
+{
+	struct nuc_led_pending_op *slot;
+	u64 wait_ns;
+	bool empty = false;
+	int ret;
+
+	while (!empty) {
+		nuc_led_state_lock();
+		slot = nuc_led_next_op(&wait_ns);
+		if (slot) {
+			list_del(&slot->list);
+			slot->queued = false;
+
+			if (slot->action == NUCLED_PROC_SET_INDICATOR)
+				ret = nuc_led_fw_set_indicator(
+					slot->led_id, slot->indicator_id);
+			else
+				ret = nuc_led_fw_set_item(slot->led_id,
+							  slot->indicator_id,
+							  slot->item_id,
+							  slot->value);
+
+			nuc_led_queue_stats.executed++;
+			if (ret) {
+				nuc_led_queue_stats.failed++;
+				pr_warn_ratelimited("Unable to set NUC LED state: WMI call failed\n");
+			}
+		}
+		empty = list_empty(&nuc_led_pending_list);
+		// Everything left is rate limited, come back for it later
+		if (!slot && !empty)
+			queue_delayed_work(system_wq, &nuc_led_queue_work,
+					   nsecs_to_jiffies(wait_ns) + 1);
+		nuc_led_state_unlock();
+		if (!slot)
+			break;
+	}
+}
+
+/* Drop a queued write that is superseded by a synchronous one */
+static void nuc_led_unqueue_op(struct nuc_led_pending_op *slot)
+{
+	if (!slot || !slot->queued)
+		return;
+
+	list_del(&slot->list);
+	slot->queued = false;
+	nuc_led_queue_stats.coalesced++;
+}
+
+/* Wait for all queued writes to reach firmware */
+static void nuc_led_queue_flush(void)
+{
+	nuc_led_state_lock();
+	nuc_led_queue_flushing = true;
+	nuc_led_state_unlock();
+
+	flush_delayed_work(&nuc_led_queue_work);
+}
+
+/* Select an LED's indicator, unless it already is the current one */
+static int nuc_led_select_indicator(u8 led_id, u8 indicator_id)
+{
+	struct nuc_led_pending_op *slot = nuc_led_pending_slot(
+		NUCLED_PROC_SET_INDICATOR, led_id, indicator_id, 0);
+	LED_INFO *led = nuc_led_find_cached_led(led_id);
+	u64 wait_ns;
+	u8 expected;
+
+	if (slot && slot->queued)
+		expected = slot->value;
+	else if (led)
+		expected = led->indicator_option;
+	else
+		expected = NUCLED_NO_ITEM;
+	if (expected == indicator_id) {
+		trace_nuc_led_cache_hit(led_id, indicator_id, NUCLED_NO_ITEM);
+		return 0;
+	}
+	trace_nuc_led_cache_miss(led_id, indicator_id, NUCLED_NO_ITEM);
+
+	if (READ_ONCE(async_writes) && slot) {
+		nuc_led_queue_op(slot, NUCLED_PROC_SET_INDICATOR, led_id,
+				 indicator_id, 0, indicator_id, false);
+		return 0;
+	}
+	if (slot && !nuc_led_take_token(led_id, &wait_ns)) {
+		nuc_led_defer_op(slot, NUCLED_PROC_SET_INDICATOR, led_id,
+				 indicator_id, 0, indicator_id, wait_ns);
+		return 0;
+	}
+	nuc_led_unqueue_op(slot);
+	return nuc_led_fw_set_indicator(led_id, indicator_id);
+}
+
+/* What an item will hold once the queue is drained, false if unknown */
+static bool nuc_led_expected_item(u8 led_id, u8 indicator_id, u8 item_id,
+				  u8 *value)
+{
+	struct nuc_led_pending_op *slot = nuc_led_pending_slot(
+		NUCLED_PROC_SETINDICATOROPTIONVALUE, led_id, indicator_id,
+		item_id);
+
+	if (slot && slot->queued) {
+		*value = slot->value;
+		return true;
+	}
+	return nuc_led_cached_item(led_id, indicator_id, item_id, value);
+}
+
+/* Set one indicator item, skipping the WMI call if it already holds value */
+static int nuc_led_set_item(u8 led_id, u8 indicator_id, u8 item_id, u8 value)
+{
+	struct nuc_led_pending_op *slot = nuc_led_pending_slot(
+		NUCLED_PROC_SETINDICATOROPTIONVALUE, led_id, indicator_id,
+		item_id);
+	u64 wait_ns;
+	u8 expected;
+
+	if (nuc_led_expected_item(led_id, indicator_id, item_id, &expected) &&
+	    expected == value) {
+		trace_nuc_led_cache_hit(led_id, indicator_id, item_id);
+		return 0;
+	}
+	trace_nuc_led_cache_miss(led_id, indicator_id, item_id);
+
+	if (READ_ONCE(async_writes) && slot) {
+		nuc_led_queue_op(slot, NUCLED_PROC_SETINDICATOROPTIONVALUE,
+				 led_id, indicator_id, item_id, value, false);
+		return 0;
+	}
+	if (slot && !nuc_led_take_token(led_id, &wait_ns)) {
+		nuc_led_defer_op(slot, NUCLED_PROC_SETINDICATOROPTIONVALUE,
+				 led_id, indicator_id, item_id, value, wait_ns);
+		return 0;
+	}
+	nuc_led_unqueue_op(slot);
+	return nuc_led_fw_set_item(led_id, indicator_id, item_id, value);
+}
+
+/*
+ * Color pipeline. Brightness (0-100) and, on RGB LEDs, red, green and
+ * blue (0-255) are perceptual values that go through lookup tables for
+ * color_gamma before they reach firmware. A color is then only sent if
+ * it differs from the one the LED shows, or will once the queue is
+ * drained, by at least color_threshold (in perceptual 0-255 steps of a
+ * channel at full brightness). Smaller changes are dropped; as they are
+ * measured against what is shown, consecutive ones add up until they
+ * are visible. Protected by nuc_led_lock.
+ */
+enum { NUCLED_COLOR_BRIGHTNESS, NUCLED_COLOR_RED, NUCLED_COLOR_GREEN,
+       NUCLED_COLOR_BLUE, NUCLED_COLOR_VALUES };
+
+static u8 nuc_led_gamma_rgb[256], nuc_led_gamma_rgb_inv[256];
+static u8 nuc_led_gamma_brightness[101], nuc_led_gamma_brightness_inv[101];
+static unsigned int nuc_led_gamma_built; /* color_gamma of the tables */
+
+static struct {
+	u64 updates; /* colors that went through the pipeline */
+	u64 suppressed; /* colors below color_threshold */
+	u64 writes_saved; /* firmware writes the suppressed colors needed */
+} nuc_led_color_stats;
+
+/* round(max * (x / max)^(gamma / 100)), in 16.16 fixed point */
+static u32 nuc_led_gamma_value(u32 x, u32 max, u32 gamma)
+{
+	u64 base = div_u64((u64)x << 16, max), result = 1 << 16;
+	u32 frac = (gamma % 100) * 65536 / 100;
+	int i;
+
+	for (i = 0; i < gamma / 100; i++)
+		result = (result * base) >> 16;
+
+	// base^(1/2), base^(1/4), ... for each bit of the fraction
+	for (i = 15; i >= 0 && frac; i--) {
+		base = int_sqrt64(base << 16);
+		if (frac & BIT(i))
+			result = (result * base) >> 16;
+	}
+	return (result * max + (1 << 15)) >> 16;
+}
+
+/* Build a table and its inverse, the smallest input reaching each output */
+static void nuc_led_gamma_table(u8 *table, u8 *inv, u32 max, u32 gamma)
+{
+	u32 x, y;
+
+	for (x = 0; x <= max; x++)
+		table[x] = nuc_led_gamma_value(x, max, gamma);
+	for (x = 0, y = 0; y <= max; y++) {
+		while (x < max && table[x] < y)
+			x++;
+		inv[y] = x;
+	}
+}
+
+static void nuc_led_gamma_tables(void)
+{
+	unsigned int gamma = READ_ONCE(color_gamma);
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (gamma == nuc_led_gamma_built)
+		return;
+	nuc_led_gamma_table(nuc_led_gamma_rgb, nuc_led_gamma_rgb_inv, 255,
+			    gamma);
+	nuc_led_gamma_table(nuc_led_gamma_brightness,
+			    nuc_led_gamma_brightness_inv, 100, gamma);
+	nuc_led_gamma_built = gamma;
+}
+
+/* hue 0-359 and saturation 0-100 to an RGB color at full value */
+static void nuc_led_hsv_to_rgb(u16 hue, u8 saturation, u8 *rgb)
+{
+	u32 f = (hue % 60) * 255 / 60;
+	u8 p = 255 * (100 - saturation) / 100;
+	u8 q = 255 * (100 * 255 - saturation * f) / (100 * 255);
+	u8 t = 255 * (100 * 255 - saturation * (255 - f)) / (100 * 255);
+
+	switch (hue / 60) {
+	case 0:
+		rgb[0] = 255, rgb[1] = t, rgb[2] = p;
+		break;
+	case 1:
+		rgb[0] = q, rgb[1] = 255, rgb[2] = p;
+		break;
+	case 2:
+		rgb[0] = p, rgb[1] = 255, rgb[2] = t;
+		break;
+	case 3:
+		rgb[0] = p, rgb[1] = q, rgb[2] = 255;
+		break;
+	case 4:
+		rgb[0] = t, rgb[1] = p, rgb[2] = 255;
+		break;
+	default:
+		rgb[0] = 255, rgb[1] = p, rgb[2] = q;
+		break;
+	}
+}
+
+/* Perceptual intensity of one channel, 0-25500 */
+static int nuc_led_color_intensity(const u8 *color, int channel)
+{
+	return color[channel] * color[NUCLED_COLOR_BRIGHTNESS];
+}
+
+/*
+ * Map a perceptual color to firmware values, and tell whether it is too
+ * close to the one shown to be worth sending.
+ */
+static bool nuc_led_color_pipeline(struct nuc_led_cmd *cmd,
+				   const struct nuc_led_color_items *items,
+				   const u8 *color, u8 *values)
+{
+	const u8 item_ids[NUCLED_COLOR_VALUES] = { items->brightness,
+						   items->red, items->green,
+						   items->blue };
+	unsigned int threshold = READ_ONCE(color_threshold);
+	LED_INFO *led = nuc_led_find_cached_led(cmd->led_id);
+	bool rgb = led && led->led_color_type.rgb;
+	u8 shown[NUCLED_COLOR_VALUES], fw[NUCLED_COLOR_VALUES];
+	int i, diff = 0, writes = 0;
+
+	nuc_led_gamma_tables();
+	nuc_led_color_stats.updates++;
+
+	// Out of range brightness is left for firmware to reject
+	values[0] = color[0] <= 100 ? nuc_led_gamma_brightness[color[0]] :
+				      color[0];
+	for (i = 1; i < NUCLED_COLOR_VALUES; i++)
+		values[i] = rgb ? nuc_led_gamma_rgb[color[i]] : color[i];
+
+	if (!threshold || cmd->exact || color[0] > 100)
+		return false;
+
+	for (i = 0; i < NUCLED_COLOR_VALUES; i++) {
+		if (!nuc_led_expected_item(cmd->led_id, cmd->indicator_id,
+					   item_ids[i], &fw[i]))
+			return false;
+		writes += fw[i] != values[i];
+	}
+	if (fw[0] > 100)
+		return false;
+
+	shown[0] = nuc_led_gamma_brightness_inv[fw[0]];
+	for (i = 1; i < NUCLED_COLOR_VALUES; i++)
+		shown[i] = rgb ? nuc_led_gamma_rgb_inv[fw[i]] : fw[i];
+
+	// Turning an LED off is always visible
+	for (i = 1; i < NUCLED_COLOR_VALUES; i++) {
+		if (nuc_led_color_intensity(color, i))
+			break;
+	}
+	if (i == NUCLED_COLOR_VALUES)
+		return false;
+
+	for (i = 1; i < NUCLED_COLOR_VALUES; i++)
+		diff = max(diff, abs(nuc_led_color_intensity(color, i) -
+				     nuc_led_color_intensity(shown, i)));
+	if (diff >= threshold * 100)
+		return false;
+
+	nuc_led_color_stats.suppressed++;
+	nuc_led_color_stats.writes_saved += writes;
+	return true;
+}
+
+/* Apply the items of a set_color, set_blink, set_led or set_hsv command */
+static int nuc_led_exec_color_cmd(struct nuc_led_cmd *cmd)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(cmd->indicator_id);
+	const struct nuc_led_color_items *items;
+	u8 item_ids[6], values[6], color[NUCLED_COLOR_VALUES];
+	bool has_color = true;
+	int i, n = 0, ret = 0;
+	u8 *a = cmd->args;
+
+	switch (cmd->action) {
+	case NUCLED_PROC_SET_COLOR: // brightness,r,g,b,slot
+		items = &layout->colors[a[4]];
+		memcpy(color, a, NUCLED_COLOR_VALUES);
+		break;
+	case NUCLED_PROC_SET_HSV: // (hue),saturation,value,slot
+		items = &layout->colors[a[3]];
+		color[NUCLED_COLOR_BRIGHTNESS] = a[2];
+		nuc_led_hsv_to_rgb(cmd->hue, a[1], &color[NUCLED_COLOR_RED]);
+		break;
+	case NUCLED_PROC_SET_BLINK: // behavior,freq,slot
+		items = &layout->colors[a[2]];
+		item_ids[n] = items->blink_behavior;
+		values[n++] = a[0];
+		item_ids[n] = items->blink_freq;
+		values[n++] = a[1];
+		has_color = false;
+		break;
+	case NUCLED_PROC_SET_LED: // brightness,behavior,freq,r,g,b,slot
+		items = &layout->colors[a[6]];
+		item_ids[n] = items->blink_behavior;
+		values[n++] = a[1];
+		item_ids[n] = items->blink_freq;
+		values[n++] = a[2];
+		color[NUCLED_COLOR_BRIGHTNESS] = a[0];
+		memcpy(&color[NUCLED_COLOR_RED], &a[3], 3);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	// Make sure there is a baseline to compare against
+	ret = nuc_led_get_cached_leds();
+	if (ret < 0)
+		return ret;
+	ret = 0;
+
+	if (has_color &&
+	    !nuc_led_color_pipeline(cmd, items, color, &values[n])) {
+		item_ids[n++] = items->brightness;
+		item_ids[n++] = items->red;
+		item_ids[n++] = items->green;
+		item_ids[n++] = items->blue;
+	}
+
+	for (i = 0; i < n && !ret; i++)
+		ret = nuc_led_set_item(cmd->led_id, cmd->indicator_id,
+				       item_ids[i], values[i]);
+
+	return ret;
+}
+
+/*
+ * Named presets: lists of set_indicator and set_indicator_value ops kept
+ * by the driver, built with preset_add and applied with one apply_preset.
+ * Protected by nuc_led_lock.
+ */
+static struct nuc_led_preset nuc_led_presets[NUCLED_MAX_PRESETS];
+
+static struct nuc_led_preset *nuc_led_find_preset(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NUCLED_MAX_PRESETS; i++) {
+		if (!strcmp(nuc_led_presets[i].name, name))
+			return &nuc_led_presets[i];
+	}
+	return NULL;
+}
+
+/* Add an op, or update the value of the preset's op for the same target */
+static int nuc_led_preset_add(struct nuc_led_cmd *cmd)
+{
+	struct nuc_led_preset *preset = nuc_led_find_preset(cmd->name);
+	struct nuc_led_preset_op op = {
+		.action = cmd->num_args ? NUCLED_PROC_SETINDICATOROPTIONVALUE :
+					  NUCLED_PROC_SET_INDICATOR,
+		.led_id = cmd->led_id,
+		.indicator_id = cmd->indicator_id,
+		.item_id = cmd->num_args ? cmd->args[0] : 0,
+		.value = cmd->num_args ? cmd->args[1] : 0,
+	};
+	int i;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (!preset) {
+		preset = nuc_led_find_preset("");
+		if (!preset) {
+			pr_warn("No room for preset %s on line %d, at most %d presets\n",
+				cmd->name, cmd->line, NUCLED_MAX_PRESETS);
+			return -ENOSPC;
+		}
+		strscpy(preset->name, cmd->name, sizeof(preset->name));
+	}
+
+	for (i = 0; i < preset->num_ops; i++) {
+		if (preset->ops[i].action == op.action &&
+		    preset->ops[i].led_id == op.led_id &&
+		    preset->ops[i].indicator_id == op.indicator_id &&
+		    preset->ops[i].item_id == op.item_id) {
+			preset->ops[i].value = op.value;
+			return 0;
+		}
+	}
+
+	if (preset->num_ops == NUCLED_PRESET_MAX_OPS) {
+		pr_warn("Preset %s on line %d is full, at most %d ops\n",
+			cmd->name, cmd->line, NUCLED_PRESET_MAX_OPS);
+		return -ENOSPC;
+	}
+	preset->ops[preset->num_ops++] = op;
+	return 0;
+}
+
+/* Forget a preset, if there is one by that name */
+static void nuc_led_preset_clear(const char *name)
+{
+	struct nuc_led_preset *preset = nuc_led_find_preset(name);
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (preset)
+		memset(preset, 0, sizeof(*preset));
+}
+
+/*
+ * Run a preset's ops in order. They go through the same cache checks as
+ * proc commands, so only ops whose target differs reach the firmware.
+ */
+static int nuc_led_apply_preset(struct nuc_led_cmd *cmd)
+{
+	struct nuc_led_preset *preset = nuc_led_find_preset(cmd->name);
+	struct nuc_led_preset_op *op;
+	int i, ret = 0;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	if (!preset) {
+		pr_warn("Unknown preset %s on line %d\n", cmd->name, cmd->line);
+		return -ENOENT;
+	}
+
+	// Compare against the current state, reading it first if need be
+	ret = nuc_led_get_cached_leds();
+	if (ret < 0)
+		return ret;
+	ret = 0;
+
+	for (i = 0; i < preset->num_ops; i++) {
+		op = &preset->ops[i];
+		if (op->action == NUCLED_PROC_SET_INDICATOR) {
+			if (nuc_led_select_indicator(op->led_id,
+						     op->indicator_id))
+				ret = -EIO;
+		} else {
+			if (nuc_led_set_item(op->led_id, op->indicator_id,
+					     op->item_id, op->value))
+				ret = -EIO;
+		}
+	}
+	return ret;
+}
+
+/* Execute one parsed command, called with nuc_led_lock held */
+static int nuc_led_exec_cmd(struct nuc_led_cmd *cmd)
+{
+	int ret = 0;
+
+	lockdep_assert_held(&nuc_led_lock);
+
+	switch (cmd->action) {
+	case NUCLED_PROC_SET_INDICATOR:
+		ret = nuc_led_select_indicator(cmd->led_id, cmd->indicator_id);
+		break;
+	case NUCLED_PROC_SETINDICATOROPTIONVALUE:
+		ret = nuc_led_set_item(cmd->led_id, cmd->indicator_id,
+				       cmd->args[0], cmd->args[1]);
+		break;
+	case NUCLED_PROC_REFRESH:
+		ret = nuc_led_get_leds();
+		if (ret > 0)
+			ret = 0;
+		break;
+	case NUCLED_PROC_SET_COLOR:
+	case NUCLED_PROC_SET_BLINK:
+	case NUCLED_PROC_SET_LED:
+	case NUCLED_PROC_SET_HSV:
+		ret = nuc_led_exec_color_cmd(cmd);
+		break;
+	case NUCLED_PROC_PRESET_ADD:
+		ret = nuc_led_preset_add(cmd);
+		break;
+	case NUCLED_PROC_PRESET_CLEAR:
+		nuc_led_preset_clear(cmd->name);
+		break;
+	case NUCLED_PROC_APPLY_PRESET:
+		ret = nuc_led_apply_preset(cmd);
+		break;
+	}
+
+	trace_nuc_led_cmd_exec(cmd->line, cmd->action, cmd->led_id,
+			       cmd->indicator_id, cmd->num_args, ret);
+	return ret;
+}
+
+/*
+ * Show a color through an LED's Software indicator, lock held. Unless
+ * exact, it goes through color_threshold like set_color.
+ */
+static int nuc_led_set_software_color(u8 led_id, u8 brightness, u8 red,
+				      u8 green, u8 blue, bool exact)
+{
+	struct nuc_led_cmd cmds[] = {
+		{
+			.action = NUCLED_PROC_SET_INDICATOR,
+			.led_id = led_id,
+			.indicator_id = NUCLED_USAGE_TYPE_SOFTWARE,
+		},
+		{
+			.action = NUCLED_PROC_SET_COLOR,
+			.led_id = led_id,
+			.indicator_id = NUCLED_USAGE_TYPE_SOFTWARE,
+			.num_args = 5,
+			.args = { brightness, red, green, blue, 0 },
+			.exact = exact,
+		},
+	};
+	int i, ret = 0;
+
+	// Cached values make repeated colors free
+	for (i = 0; i < ARRAY_SIZE(cmds) && !ret; i++)
+		ret = nuc_led_exec_cmd(&cmds[i]);
+
+	return ret;
+}
+
+/* Result of one command line of the last batch written through a file */
+struct nuc_led_line_result {
+	int line;
+	int result; /* 0, the error, or -ECANCELED if it wasn't executed */
+};
+
+static void nuc_led_seq_set_results(struct file *file,
+				    struct nuc_led_line_result *results,
+				    int num_results);
+
+/*
+ * A write holds one command per line. The whole batch is parsed and
+ * validated before anything is sent to firmware, and is then executed
+ * in order under a single lock. The write fails with the error of the
+ * first failing line; the result of every line can be read back through
+ * the same open file, see nuc_led_seq_show().
+ */
+static ssize_t acpi_proc_write(struct file *filp, const char __user *buff,
+			       size_t len, loff_t *data)
+{
+	int i, line = 0, num_cmds = 0, max_cmds = 1;
+	int ret = 0, err;
+	char *input, *arg, *sep;
+	struct nuc_led_cmd *cmds, *cmd;
+	struct nuc_led_line_result *results;
+
+	if (len == 0)
+		return 0;
+	if (len > NUCLED_PROC_MAX_INPUT)
+		return -E2BIG;
+
+	// Move buffer from user space to kernel space
+	input = memdup_user_nul(buff, len);
+	if (IS_ERR(input))
+		return PTR_ERR(input);
+
+	for (i = 0; i < len; i++) {
+		if (input[i] == '\n')
+			max_cmds++;
+	}
+
+	cmds = kcalloc(max_cmds, sizeof(*cmds), GFP_KERNEL);
+	results = kcalloc(max_cmds, sizeof(*results), GFP_KERNEL);
+	if (!cmds || !results) {
+		kfree(cmds);
+		kfree(results);
+		kfree(input);
+		return -ENOMEM;
+	}
+
+	// Parse and validate every line before executing any of them
+	sep = input;
+	while ((arg = strsep(&sep, "\n"))) {
+		line++;
+		arg = strim(arg);
+		if (!*arg || *arg == '#')
+			continue;
+
+		cmd = &cmds[num_cmds];
+		err = nuc_led_parse_cmd(arg, line, cmd);
+		trace_nuc_led_cmd_parse(line, cmd->action, cmd->led_id,
+					cmd->indicator_id, cmd->num_args, err);
+		results[num_cmds].line = line;
+		results[num_cmds++].result = err;
+		if (err && !ret)
+			ret = err;
+	}
+
+	kfree(input);
+
+	if (ret != 0) {
+		for (i = 0; i < num_cmds; i++) {
+			if (!results[i].result)
+				results[i].result = -ECANCELED;
+		}
+		goto out;
+	}
+
+	nuc_led_state_lock();
+	for (i = 0; i < num_cmds; i++) {
+		err = nuc_led_exec_cmd(&cmds[i]);
+		if (err && err != -ENOENT && err != -ENOSPC) {
+			pr_warn("Unable to set NUC LED state on line %d: WMI call failed\n",
+				cmds[i].line);
+			err = -EIO;
+		}
+		// Unknown or full presets are already reported
+		results[i].result = err;
+		if (err && !ret)
+			ret = err;
+	}
+	nuc_led_state_unlock();
+
+out:
+	nuc_led_seq_set_results(filp, results, num_cmds);
+	kfree(cmds);
+
+	return ret ? ret : len;
+}
+
+static void print_color(struct seq_file *m, LED_RGB *rgb)
+{
+	seq_printf(m, "rgb(%d,%d,%d)", rgb->red, rgb->green, rgb->blue);
+}
+
+static void print_blink_led(struct seq_file *m, BLINK_LED *led)
+{
+	seq_printf(m, "%d%% %s ", led->brightness,
+		   led_blink_behaviors[led->blink_behavior]);
+	print_color(m, &led->color);
+	seq_printf(m, " (%d dHz)", led->blink_freq);
+}
+
+static void print_flash_led(struct seq_file *m, FLASH_LED *led)
+{
+	seq_printf(m, "%d%% ", led->brightness);
+	print_color(m, &led->color);
+}
+
+static void print_led(struct seq_file *m, struct nuc_led_ioc_led *led)
+{
+	const char *name = led->led_type < ARRAY_SIZE(led_names) ?
+				   led_names[led->led_type] : "Unknown";
+	int i;
+	struct power_state_indicator *power_state_ind;
+	struct hdd_activity_indicator *hdd_activity_ind;
+	struct ethernet_indicator *ethernet_ind;
+	struct wifi_indicator *wifi_ind;
+	struct software_indicator *software_ind;
+	struct power_limit_indicator *power_limit_ind;
+
+	seq_printf(m, "LED %i (%s) - Color type: %s\n", led->led_type, name,
+		   led_color_types[bitIndexToIndex(led->color_type)]);
+
+	seq_puts(m, "  Supported indicators: ");
+	// Bit 7 has no name in led_usage_types
+	for (i = 1; i < BIT(ARRAY_SIZE(led_usage_types)); i = i << 1) {
+		if (led->usage_type & i) {
+			seq_printf(m, "%s  ",
+				   led_usage_types[bitIndexToIndex(i)]);
+		}
+	}
+
+	seq_printf(m, "\n  Current indicator: %s\n",
+		   led_usage_types[led->indicator_option]);
+
+	if (!led->indicator_size)
+		return;
+
+	switch (led->indicator_option) {
+	case NUCLED_USAGE_TYPE_POWER_STATE:
+		power_state_ind =
+			(struct power_state_indicator *)led->indicator;
+
+		seq_puts(m, "\n        S0 (On): ");
+		print_blink_led(m, &power_state_ind->s0);
+		seq_puts(m, "\n     S3 (Sleep): ");
+		print_blink_led(m, &power_state_ind->s3);
+		seq_puts(m, "\n     Ready mode: ");
+		print_blink_led(m, &power_state_ind->ready_mode);
+		seq_puts(m, "\n  S5 (Soft off): ");
+		print_blink_led(m, &power_state_ind->s5);
+		seq_puts(m, "\n");
+		break;
+	case NUCLED_USAGE_TYPE_HDD_ACTIVITY:
+		hdd_activity_ind =
+			(struct hdd_activity_indicator *)led->indicator;
+		seq_puts(m, "\n  HDD LED: ");
+		print_flash_led(m, &hdd_activity_ind->led);
+		seq_printf(m, " %s\n",
+			   led_flash_behaviors[hdd_activity_ind->behavior]);
+		break;
+	case NUCLED_USAGE_TYPE_ETHERNET:
+		ethernet_ind =
+			(struct ethernet_indicator *)led->indicator;
+		seq_puts(m, "\n  Ethernet LED: ");
+		seq_printf(m, "%s  ", led_ethernet_type[ethernet_ind->type]);
+		print_flash_led(m, &ethernet_ind->led);
+		seq_puts(m, "\n");
+		break;
+	case NUCLED_USAGE_TYPE_WIFI:
+		wifi_ind =
+			(struct wifi_indicator *)led->indicator;
+		seq_puts(m, "\n  Wifi LED: ");
+		print_flash_led(m, &wifi_ind->led);
+		seq_puts(m, "\n");
+		break;
+	case NUCLED_USAGE_TYPE_SOFTWARE:
+		software_ind =
+			(struct software_indicator *)led->indicator;
+		seq_puts(m, "\n  Software LED: ");
+		print_blink_led(m, &software_ind->led);
+		seq_puts(m, "\n");
+		break;
+	case NUCLED_USAGE_TYPE_POWER_LIMIT:
+		power_limit_ind =
+			(struct power_limit_indicator *)led->indicator;
+		seq_puts(m, "\n  Power Limit LED: ");
+		seq_printf(m, "%s  ",
+			   led_power_limit_indication_scheme[power_limit_ind->indication_scheme]);
+		print_flash_led(m, &power_limit_ind->led);
+		seq_puts(m, "\n");
+		break;
+	default:
+		break;
+	}
+}
+
+static const char *nuc_led_short_name(struct nuc_led_ioc_led *led)
+{
+	return led->led_type < ARRAY_SIZE(led_short_names) ?
+		       led_short_names[led->led_type] : "unknown";
+}
+
+/*
+ * output_format=json: one object per LED with the raw bytes of its
+ * current indicator, keyed by the sysfs field names.
+ */
+static void print_led_json(struct seq_file *m, struct nuc_led_ioc_led *led)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(led->indicator_option);
+	const char *indicator = nuc_led_indicator_name(led->indicator_option);
+	const char *sep = "";
+	int i;
+
+	seq_printf(m, "{\"led_type\":%u,\"name\":\"%s\",\"color_type\":%u,"
+		      "\"usage_type\":%u,\"indicator_option\":%u,"
+		      "\"indicator\":\"%s\",\"values\":{",
+		   led->led_type, nuc_led_short_name(led), led->color_type,
+		   led->usage_type, led->indicator_option,
+		   indicator ? indicator : "unknown");
+
+	for (i = 0; layout && i < layout->num_fields; i++) {
+		if (layout->fields[i].item_id >= led->indicator_size)
+			continue;
+		seq_printf(m, "%s\"%s\":%u", sep, layout->fields[i].name,
+			   led->indicator[layout->fields[i].item_id]);
+		sep = ",";
+	}
+	seq_puts(m, "}}");
+}
+
+/* output_format=kv: <led>.<key>=<value> lines, same keys as JSON */
+static void print_led_kv(struct seq_file *m, struct nuc_led_ioc_led *led)
+{
+	const struct nuc_led_indicator_layout *layout =
+		nuc_led_indicator_layout(led->indicator_option);
+	const char *indicator = nuc_led_indicator_name(led->indicator_option);
+	const char *name = nuc_led_short_name(led);
+	int i;
+
+	seq_printf(m, "%s.led_type=%u\n", name, led->led_type);
+	seq_printf(m, "%s.color_type=%u\n", name, led->color_type);
+	seq_printf(m, "%s.usage_type=%u\n", name, led->usage_type);
+	seq_printf(m, "%s.indicator_option=%u\n", name, led->indicator_option);
+	seq_printf(m, "%s.indicator=%s\n", name,
+		   indicator ? indicator : "unknown");
+
+	for (i = 0; layout && i < layout->num_fields; i++) {
+		if (layout->fields[i].item_id >= led->indicator_size)
+			continue;
+		seq_printf(m, "%s.%s.%s=%u\n", name, layout->name,
+			   layout->fields[i].name,
+			   led->indicator[layout->fields[i].item_id]);
+	}
+}
+
+/*
+ * The dump is streamed through seq_file one LED at a time from the
+ * published snapshot. The RCU read lock is held from start to stop, so
+ * every read() sees a consistent LED table without blocking writers.
+ *
+ * Position 0 is a header carrying the snapshot generation in the
+ * machine-readable formats and the result of each line of the last batch
+ * written through the file, LED i is at position i + 1.
+ */
+struct nuc_led_seq_state {
+	struct nuc_led_snapshot *snap;
+	unsigned int format; /* output_format when the file was opened */
+	u64 generation; /* of the last dump started, for poll() */
+	struct nuc_led_line_result *results; /* protected by the seq_file lock */
+	int num_results;
+};
+
+/* Keep the results of a batch written through file, for reading back */
+static void nuc_led_seq_set_results(struct file *file,
+				    struct nuc_led_line_result *results,
+				    int num_results)
+{
+	struct seq_file *m = file->private_data;
+	struct nuc_led_seq_state *state = m->private;
+	struct nuc_led_line_result *old;
+
+	mutex_lock(&m->lock);
+	old = state->results;
+	state->results = results;
+	state->num_results = num_results;
+	mutex_unlock(&m->lock);
+
+	kfree(old);
+}
+
+static void print_line_results(struct seq_file *m,
+			       struct nuc_led_seq_state *state)
+{
+	struct nuc_led_line_result *r;
+	int i;
+
+	for (i = 0; i < state->num_results; i++) {
+		r = &state->results[i];
+		switch (state->format) {
+		case NUCLED_OUTPUT_JSON:
+			seq_printf(m, "%s{\"line\":%d,\"result\":%d}",
+				   i ? "," : "", r->line, r->result);
+			break;
+		case NUCLED_OUTPUT_KV:
+			seq_printf(m, "result.line%d=%d\n", r->line,
+				   r->result);
+			break;
+		default:
+			if (r->result)
+				seq_printf(m, "Line %d: error %d\n", r->line,
+					   r->result);
+			else
+				seq_printf(m, "Line %d: ok\n", r->line);
+			break;
+		}
+	}
+}
+
+static void *nuc_led_seq_led(struct nuc_led_seq_state *state, loff_t pos)
+{
+	struct nuc_led_snapshot *snap = state->snap;
+
+	if (!snap || pos > snap->num_leds)
+		return NULL;
+	return &snap->leds[pos - 1];
+}
+
+static void *nuc_led_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct nuc_led_seq_state *state = m->private;
+	int ret;
+
+	// Served from the LED cache, only the first read hits firmware
+	ret = nuc_led_populate();
+
+	rcu_read_lock();
+	if (ret < 0) {
+		// The results of a batch are still worth reading
+		if (*pos || !state->results)
+			return ERR_PTR(ret);
+		state->snap = NULL;
+		return SEQ_START_TOKEN;
+	}
+
+	state->snap = rcu_dereference(nuc_led_snapshot);
+	if (!*pos) {
+		WRITE_ONCE(state->generation,
+			   state->snap ? state->snap->generation : 0);
+		return SEQ_START_TOKEN;
+	}
+
+	return nuc_led_seq_led(state, *pos);
+}
+
+static void *nuc_led_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	++*pos;
+	return nuc_led_seq_led(m->private, *pos);
+}
+
+static void nuc_led_seq_stop(struct seq_file *m, void *v)
+{
+	rcu_read_unlock();
+}
+
+static int nuc_led_seq_show(struct seq_file *m, void *v)
+{
+	struct nuc_led_seq_state *state = m->private;
+	struct nuc_led_snapshot *snap = state->snap;
+	u32 num_leds = snap ? snap->num_leds : 0;
+	struct nuc_led_ioc_led *led = v;
+	bool last;
+
+	if (v == SEQ_START_TOKEN) {
+		if (state->format == NUCLED_OUTPUT_JSON) {
+			seq_printf(m, "{\"generation\":%llu,",
+				   snap ? snap->generation : 0);
+			if (state->results) {
+				seq_puts(m, "\"results\":[");
+				print_line_results(m, state);
+				seq_puts(m, "],");
+			}
+			seq_printf(m, "\"leds\":[%s", num_leds ? "" : "]}\n");
+		} else if (state->format == NUCLED_OUTPUT_KV) {
+			seq_printf(m, "generation=%llu\n",
+				   snap ? snap->generation : 0);
+			print_line_results(m, state);
+		} else if (state->results) {
+			print_line_results(m, state);
+			seq_puts(m, "\n");
+		}
+		return 0;
+	}
+
+	last = led == &snap->leds[num_leds - 1];
+	switch (state->format) {
+	case NUCLED_OUTPUT_JSON:
+		if (led != snap->leds)
+			seq_putc(m, ',');
+		print_led_json(m, led);
+		if (last)
+			seq_puts(m, "]}\n");
+		break;
+	case NUCLED_OUTPUT_KV:
+		print_led_kv(m, led);
+		break;
+	default:
+		if (led != snap->leds)
+			seq_puts(m, "\n\n");
+		print_led(m, led);
+		break;
+	}
+
+	return 0;
+}
+
+static const struct seq_operations nuc_led_seq_ops = {
+	.start = nuc_led_seq_start,
+	.next = nuc_led_seq_next,
+	.stop = nuc_led_seq_stop,
+	.show = nuc_led_seq_show,
+};
+
+static int acpi_proc_open(struct inode *inode, struct file *file)
+{
+	struct nuc_led_seq_state *state;
+
+	state = __seq_open_private(file, &nuc_led_seq_ops, sizeof(*state));
+	if (!state)
+		return -ENOMEM;
+
+	state->format = READ_ONCE(output_format);
+	return 0;
+}
+
+static int acpi_proc_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+	struct nuc_led_seq_state *state = m->private;
+
+	kfree(state->results);
+	return seq_release_private(inode, file);
+}
+
+/* Readable, or woken up, once the state moves past generation */
+static __poll_t nuc_led_poll_generation(struct file *file, poll_table *wait,
+					u64 generation)
+{
+	poll_wait(file, &nuc_led_wait, wait);
+
+	if (READ_ONCE(nuc_led_generation) != generation)
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+/* Readable when the state changed since the dump was last read from the top */
+static __poll_t acpi_proc_poll(struct file *file, poll_table *wait)
+{
+	struct seq_file *m = file->private_data;
+	struct nuc_led_seq_state *state = m->private;
+
+	return nuc_led_poll_generation(file, wait, READ_ONCE(state->generation));
+}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 6, 0)
+static const struct proc_ops proc_acpi_operations = {
+	.proc_open = acpi_proc_open,
+	.proc_read = seq_read,
+	.proc_lseek = seq_lseek,
+	.proc_poll = acpi_proc_poll,
+	.proc_release = acpi_proc_release,
+	.proc_write = acpi_proc_write,
+};
+#else
+static const struct file_operations proc_acpi_operations = {
+	.owner = THIS_MODULE,
+	.open = acpi_proc_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.poll = acpi_proc_poll,
+	.release = acpi_proc_release,
+	.write = acpi_proc_write,
+};
+#endif
+
+/* An open /dev/nuc_led */
+struct nuc_led_dev_file {
+	u64 generation; /* the state last seen through this file */
+};
+
+static long nuc_led_ioctl_get_leds(struct nuc_led_dev_file *df,
+				   void __user *argp)
+{
+	struct nuc_led_ioc_table table = { .version = NUCLED_IOC_VERSION };
+	struct nuc_led_snapshot *snap;
+	int ret;
+
+	ret = nuc_led_populate();
+	if (ret < 0)
+		return ret;
+
+	rcu_read_lock();
+	snap = rcu_dereference(nuc_led_snapshot);
+	if (snap) {
+		table.num_leds = snap->num_leds;
+		memcpy(table.leds, snap->leds, sizeof(table.leds));
+		WRITE_ONCE(df->generation, snap->generation);
+	}
+	rcu_read_unlock();
+
+	if (copy_to_user(argp, &table, sizeof(table)))
+		return -EFAULT;
+	return 0;
+}
+
+/* Copy the current indicator of an LED from the snapshot, if it is the one */
+static bool nuc_led_snapshot_indicator(struct nuc_led_ioc_indicator *ind)
+{
+	struct nuc_led_snapshot *snap;
+	bool found = false;
+	int i;
+
+	rcu_read_lock();
+	snap = rcu_dereference(nuc_led_snapshot);
+	for (i = 0; snap && i < snap->num_leds; i++) {
+		if (snap->leds[i].led_type != ind->led_type)
+			continue;
+		if (snap->leds[i].indicator_option == ind->indicator_option &&
+		    snap->leds[i].indicator_size == ind->size) {
+			memcpy(ind->values, snap->leds[i].indicator, ind->size);
+			found = true;
+		}
+		break;
+	}
+	rcu_read_unlock();
+
+	return found;
+}
+
+static long nuc_led_ioctl_get_indicator(void __user *argp)
+{
+	struct nuc_led_ioc_indicator ind;
+	int ret = 0;
+
+	if (copy_from_user(&ind, argp, sizeof(ind)))
+		return -EFAULT;
+
+	ind.size = nuc_led_indicator_size(ind.indicator_option);
+	if (!ind.size)
+		return -EINVAL;
+	memset(ind.values, 0, sizeof(ind.values));
+
+	ret = nuc_led_populate();
+	if (ret)
+		return ret;
+	if (nuc_led_snapshot_indicator(&ind)) {
+		trace_nuc_led_cache_hit(ind.led_type, ind.indicator_option,
+					NUCLED_NO_ITEM);
+	} else {
+		// Only the current indicator is cached
+		trace_nuc_led_cache_miss(ind.led_type, ind.indicator_option,
+					 NUCLED_NO_ITEM);
+		nuc_led_state_lock();
+		ret = nuc_led_get_indicator_items(ind.led_type,
+						  ind.indicator_option,
+						  ind.size, ind.values);
+		nuc_led_state_unlock();
+	}
+
+	if (ret)
+		return ret;
+
+	if (copy_to_user(argp, &ind, sizeof(ind)))
+		return -EFAULT;
+	return 0;
+}
+
+/* Execute one op of NUCLED_IOC_APPLY, called with nuc_led_lock held */
+static int nuc_led_exec_op(struct nuc_led_ioc_op *op)
+{
+	struct nuc_led_cmd cmd = {
+		.led_id = op->led_type,
+		.indicator_id = op->indicator_option,
+	};
+
+	switch (op->action) {
+	case NUCLED_OP_SET_INDICATOR:
+		cmd.action = NUCLED_PROC_SET_INDICATOR;
+		break;
+	case NUCLED_OP_SET_VALUE:
+		cmd.action = NUCLED_PROC_SETINDICATOROPTIONVALUE;
+		cmd.num_args = 2;
+		cmd.args[0] = op->item;
+		cmd.args[1] = op->value;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return nuc_led_exec_cmd(&cmd);
+}
+
+/* Apply an array of ops in order, each one gets its own result code */
+static long nuc_led_ioctl_apply(void __user *argp)
+{
+	struct nuc_led_ioc_ops req;
+	struct nuc_led_ioc_op *ops;
+	size_t size;
+	int i;
+
+	if (copy_from_user(&req, argp, sizeof(req)))
+		return -EFAULT;
+
+	if (req.flags || req.count > NUCLED_IOC_MAX_OPS)
+		return -EINVAL;
+	if (!req.count)
+		return 0;
+
+	size = req.count * sizeof(*ops);
+	ops = memdup_user(u64_to_user_ptr(req.ops), size);
+	if (IS_ERR(ops))
+		return PTR_ERR(ops);
+
+	nuc_led_state_lock();
+	for (i = 0; i < req.count; i++)
+		ops[i].result = nuc_led_exec_op(&ops[i]);
+	nuc_led_state_unlock();
+
+	if (copy_to_user(u64_to_user_ptr(req.ops), ops, size)) {
+		kfree(ops);
+		return -EFAULT;
+	}
+
+	kfree(ops);
+	return 0;
+}
+
+/*
+ * Keyframe animations, played back by a single delayed work item that
+ * updates all playing LEDs at most anim_max_hz times a second. Protected
+ * by nuc_led_lock.
+ */
+struct nuc_led_animation {
+	struct nuc_led_keyframe *keyframes;
+	u32 num_keyframes;
+	u32 flags;
+	bool playing;
+	ktime_t start;
+};
+
+static struct nuc_led_animation nuc_led_anims[NUCLED_MAX_LEDS];
+
+static void nuc_led_anim_step(struct work_struct *work);
+static DECLARE_DELAYED_WORK(nuc_led_anim_work, nuc_led_anim_step);
+
+static unsigned long nuc_led_anim_interval(void)
+{
+	unsigned int hz = clamp_t(unsigned int, READ_ONCE(anim_max_hz), 1,
+				  1000);
+
+	return max(msecs_to_jiffies(1000 / hz), 1UL);
+}
+
+/* Map t in [0, 1024] through an easing curve, also in [0, 1024] */
+static u32 nuc_led_ease(u8 easing, u32 t)
+{
+	switch (easing) {
+	case NUCLED_EASE_IN:
+		return t * t / 1024;
+	case NUCLED_EASE_OUT:
+		return t * (2048 - t) / 1024;
+	case NUCLED_EASE_IN_OUT:
+		if (t < 512)
+			return 2 * t * t / 1024;
+		return 1024 - 2 * (1024 - t) * (1024 - t) / 1024;
+	case NUCLED_EASE_STEP:
+		return 0;
+	default:
+		return t;
+	}
+}
+
+static u8 nuc_led_lerp(u8 from, u8 to, u32 t)
+{
+	return from + ((int)to - (int)from) * (int)t / 1024;
+}
+
+/* Compute the frame of an animation at elapsed_ms */
+static void nuc_led_anim_frame(struct nuc_led_animation *anim, u64 elapsed_ms,
+			       struct nuc_led_keyframe *frame)
+{
+	struct nuc_led_keyframe *kf = anim->keyframes;
+	struct nuc_led_keyframe *from, *to;
+	u32 k, t;
+
+	if (elapsed_ms <= kf[0].time_ms) {
+		*frame = kf[0];
+		return;
+	}
+
+	for (k = 1; k < anim->num_keyframes; k++) {
+		if (elapsed_ms < kf[k].time_ms)
+			break;
+	}
+	if (k == anim->num_keyframes) {
+		*frame = kf[k - 1];
+		return;
+	}
+
+	from = &kf[k - 1];
+	to = &kf[k];
+	t = div_u64((elapsed_ms - from->time_ms) * 1024,
+		    to->time_ms - from->time_ms);
+	t = nuc_led_ease(from->easing, t);
+
+	*frame = *from;
+	frame->brightness = nuc_led_lerp(from->brightness, to->brightness, t);
+	frame->red = nuc_led_lerp(from->red, to->red, t);
+	frame->green = nuc_led_lerp(from->green, to->green, t);
+	frame->blue = nuc_led_lerp(from->blue, to->blue, t);
+}
+
+static void nuc_led_anim_step(struct work_struct *work)
+{
+	struct nuc_led_animation *anim;
+	struct nuc_led_keyframe frame;
+	ktime_t now = ktime_get();
+	bool playing = false;
+	u32 duration, offset;
+	u64 elapsed;
+	int i;
+
+	nuc_led_state_lock();
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		anim = &nuc_led_anims[i];
+		if (!anim->playing)
+			continue;
+
+		elapsed = ktime_ms_delta(now, anim->start);
+		duration = anim->keyframes[anim->num_keyframes - 1].time_ms;
+		if (elapsed >= duration) {
+			if ((anim->flags & NUCLED_ANIM_LOOP) && duration) {
+				// Time into the current loop
+				div_u64_rem(elapsed, duration, &offset);
+				elapsed = offset;
+			} else {
+				anim->playing = false; // Last frame below
+			}
+		}
+
+		nuc_led_anim_frame(anim, elapsed, &frame);
+		// The last frame lands exactly, whatever the threshold
+		if (nuc_led_set_software_color(i, frame.brightness, frame.red,
+					       frame.green, frame.blue,
+					       !anim->playing)) {
+			pr_warn("Stopping animation of LED %i: WMI call failed\n",
+				i);
+			anim->playing = false;
+		}
+		playing |= anim->playing;
+	}
+	nuc_led_state_unlock();
+
+	if (playing)
+		schedule_delayed_work(&nuc_led_anim_work,
+				      nuc_led_anim_interval());
+}
+
+static long nuc_led_ioctl_anim_load(void __user *argp)
+{
+	struct nuc_led_ioc_animation req;
+	struct nuc_led_keyframe *keyframes;
+	struct nuc_led_animation *anim;
+	u32 i;
+
+	if (copy_from_user(&req, argp, sizeof(req)))
+		return -EFAULT;
+
+	if (req.led_type >= NUCLED_MAX_LEDS ||
+	    req.flags & ~NUCLED_ANIM_LOOP || !req.num_keyframes ||
+	    req.num_keyframes > NUCLED_ANIM_MAX_KEYFRAMES)
+		return -EINVAL;
+
+	keyframes = memdup_user(u64_to_user_ptr(req.keyframes),
+				req.num_keyframes * sizeof(*keyframes));
+	if (IS_ERR(keyframes))
+		return PTR_ERR(keyframes);
+
+	for (i = 0; i < req.num_keyframes; i++) {
+		if (keyframes[i].brightness > 100 ||
+		    keyframes[i].easing > NUCLED_EASE_STEP ||
+		    (i && keyframes[i].time_ms < keyframes[i - 1].time_ms)) {
+			kfree(keyframes);
+			return -EINVAL;
+		}
+	}
+
+	nuc_led_state_lock();
+	anim = &nuc_led_anims[req.led_type];
+	kfree(anim->keyframes);
+	anim->keyframes = keyframes;
+	anim->num_keyframes = req.num_keyframes;
+	anim->flags = req.flags;
+	anim->playing = false;
+	nuc_led_state_unlock();
+
+	return 0;
+}
+
+/* Start the animations of all LEDs in mask with one common start time */
+static long nuc_led_ioctl_anim_start(void __user *argp)
+{
+	ktime_t start = ktime_get();
+	int i, ret = 0;
+	u32 mask;
+
+	if (get_user(mask, (u32 __user *)argp))
+		return -EFAULT;
+
+	if (!mask || mask >= BIT(NUCLED_MAX_LEDS))
+		return -EINVAL;
+
+	nuc_led_state_lock();
+	ret = nuc_led_get_cached_leds();
+	if (ret < 0) {
+		nuc_led_state_unlock();
+		return ret;
+	}
+	ret = 0;
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		if ((mask & BIT(i)) &&
+		    (!nuc_led_anims[i].keyframes || !nuc_led_find_cached_led(i)))
+			ret = -ENOENT;
+	}
+	if (!ret) {
+		for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+			if (!(mask & BIT(i)))
+				continue;
+			nuc_led_anims[i].start = start;
+			nuc_led_anims[i].playing = true;
+		}
+	}
+	nuc_led_state_unlock();
+
+	if (!ret)
+		mod_delayed_work(system_wq, &nuc_led_anim_work, 0);
+
+	return ret;
+}
+
+static long nuc_led_ioctl_anim_stop(void __user *argp)
+{
+	u32 mask;
+	int i;
+
+	if (get_user(mask, (u32 __user *)argp))
+		return -EFAULT;
+
+	// Stopped LEDs keep showing their current frame
+	nuc_led_state_lock();
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		if (mask & BIT(i))
+			nuc_led_anims[i].playing = false;
+	}
+	nuc_led_state_unlock();
+
+	return 0;
+}
+
+static void nuc_led_free_animations(void)
+{
+	int i;
+
+	cancel_delayed_work_sync(&nuc_led_anim_work);
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		kfree(nuc_led_anims[i].keyframes);
+		nuc_led_anims[i].keyframes = NULL;
+		nuc_led_anims[i].playing = false;
+	}
+}
+
+static long nuc_led_dev_ioctl(struct file *filp, unsigned int cmd,
+			      unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+
+	switch (cmd) {
+	case NUCLED_IOC_GET_VERSION:
+		return put_user((__u32)NUCLED_IOC_VERSION, (__u32 __user *)argp);
+	case NUCLED_IOC_GET_LEDS:
+		return nuc_led_ioctl_get_leds(filp->private_data, argp);
+	case NUCLED_IOC_GET_INDICATOR:
+		return nuc_led_ioctl_get_indicator(argp);
+	case NUCLED_IOC_APPLY:
+		if (!(filp->f_mode & FMODE_WRITE))
+			return -EBADF;
+		return nuc_led_ioctl_apply(argp);
+	case NUCLED_IOC_ANIM_LOAD:
+		if (!(filp->f_mode & FMODE_WRITE))
+			return -EBADF;
+		return nuc_led_ioctl_anim_load(argp);
+	case NUCLED_IOC_ANIM_START:
+		if (!(filp->f_mode & FMODE_WRITE))
+			return -EBADF;
+		return nuc_led_ioctl_anim_start(argp);
+	case NUCLED_IOC_ANIM_STOP:
+		if (!(filp->f_mode & FMODE_WRITE))
+			return -EBADF;
+		return nuc_led_ioctl_anim_stop(argp);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0) && defined(CONFIG_COMPAT)
+/* 32-bit callers pass their pointers as compat_uptr_t */
+static long nuc_led_dev_compat_ioctl(struct file *filp, unsigned int cmd,
+				     unsigned long arg)
+{
+	return nuc_led_dev_ioctl(filp, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+/* Map the shared state page read-only */
+static int nuc_led_dev_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	int ret;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	// Make sure there is something to look at
+	ret = nuc_led_populate();
+	if (ret)
+		return ret;
+
+	return vm_insert_page(vma, vma->vm_start,
+			      virt_to_page(nuc_led_shared));
+}
+
+static int nuc_led_dev_open(struct inode *inode, struct file *filp)
+{
+	struct nuc_led_dev_file *df = kzalloc(sizeof(*df), GFP_KERNEL);
+
+	if (!df)
+		return -ENOMEM;
+
+	df->generation = READ_ONCE(nuc_led_generation);
+	filp->private_data = df;
+	return 0;
+}
+
+static int nuc_led_dev_release(struct inode *inode, struct file *filp)
+{
+	kfree(filp->private_data);
+	return 0;
+}
+
+/*
+ * Wait until the state changes from the one last seen through this file,
+ * at open or by NUCLED_IOC_GET_LEDS, and return its generation as a __u64.
+ */
+static ssize_t nuc_led_dev_read(struct file *filp, char __user *buf,
+				size_t len, loff_t *ppos)
+{
+	struct nuc_led_dev_file *df = filp->private_data;
+	u64 generation;
+	int ret;
+
+	if (len < sizeof(generation))
+		return -EINVAL;
+
+	if (filp->f_flags & O_NONBLOCK) {
+		if (READ_ONCE(nuc_led_generation) == READ_ONCE(df->generation))
+			return -EAGAIN;
+	} else {
+		ret = wait_event_interruptible(
+			nuc_led_wait, READ_ONCE(nuc_led_generation) !=
+					      READ_ONCE(df->generation));
+		if (ret)
+			return ret;
+	}
+
+	generation = READ_ONCE(nuc_led_generation);
+	WRITE_ONCE(df->generation, generation);
+	if (copy_to_user(buf, &generation, sizeof(generation)))
+		return -EFAULT;
+	return sizeof(generation);
+}
+
+static __poll_t nuc_led_dev_poll(struct file *filp, poll_table *wait)
+{
+	struct nuc_led_dev_file *df = filp->private_data;
+
+	return nuc_led_poll_generation(filp, wait, READ_ONCE(df->generation));
+}
+
+static const struct file_operations nuc_led_dev_operations = {
+	.owner = THIS_MODULE,
+	.open = nuc_led_dev_open,
+	.read = nuc_led_dev_read,
+	.poll = nuc_led_dev_poll,
+	.release = nuc_led_dev_release,
+	.unlocked_ioctl = nuc_led_dev_ioctl,
+	.mmap = nuc_led_dev_mmap,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	.compat_ioctl = compat_ptr_ioctl,
+#elif defined(CONFIG_COMPAT)
+	.compat_ioctl = nuc_led_dev_compat_ioctl,
+#endif
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice nuc_led_miscdev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "nuc_led",
+	.fops = &nuc_led_dev_operations,
+};
+
+/*
+ * One KOBJ_CHANGE uevent on /dev/nuc_led per LED that changed, with its
+ * current indicator and the generation of the state it was read from.
+ */
+static void nuc_led_send_uevents(struct work_struct *work)
+{
+	char led_env[24], name_env[32], indicator_env[24];
+	char indicator_name_env[48], generation_env[40];
+	char *envp[] = { led_env, name_env, indicator_env, indicator_name_env,
+			 generation_env, NULL };
+	struct nuc_led_snapshot *snap, copy = {};
+	struct nuc_led_ioc_led *led;
+	const char *indicator;
+	unsigned long changed;
+	int i;
+
+	nuc_led_state_lock();
+	changed = nuc_led_uevent_leds;
+	nuc_led_uevent_leds = 0;
+	nuc_led_state_unlock();
+
+	rcu_read_lock();
+	snap = rcu_dereference(nuc_led_snapshot);
+	if (snap)
+		copy = *snap;
+	rcu_read_unlock();
+
+	for (i = 0; i < copy.num_leds; i++) {
+		led = &copy.leds[i];
+		if (!(changed & BIT(led->led_type)))
+			continue;
+
+		indicator = nuc_led_indicator_name(led->indicator_option);
+		snprintf(led_env, sizeof(led_env), "NUCLED_LED=%u",
+			 led->led_type);
+		snprintf(name_env, sizeof(name_env), "NUCLED_LED_NAME=%s",
+			 nuc_led_short_name(led));
+		snprintf(indicator_env, sizeof(indicator_env),
+			 "NUCLED_INDICATOR=%u", led->indicator_option);
+		snprintf(indicator_name_env, sizeof(indicator_name_env),
+			 "NUCLED_INDICATOR_NAME=%s",
+			 indicator ? indicator : "unknown");
+		snprintf(generation_env, sizeof(generation_env),
+			 "NUCLED_GENERATION=%llu", copy.generation);
+
+		if (!kobject_uevent_env(&nuc_led_miscdev.this_device->kobj,
+					KOBJ_CHANGE, envp))
+			atomic64_inc(&nuc_led_uevents_sent);
+	}
+}
+
+#if IS_ENABLED(CONFIG_LEDS_CLASS_MULTICOLOR)
+/*
+ * LED class device for an RGB LED, backed by its Software indicator so
+ * that in-kernel triggers can drive it. The class brightness scales the
+ * firmware brightness (0-100%), multi_intensity holds the RGB color.
+ */
+struct nuc_led_classdev {
+	struct led_classdev_mc mc_cdev;
+	struct mc_subled subleds[3];
+	char name[32];
+	u8 led_type;
+};
+
+static struct nuc_led_classdev *nuc_led_cdevs[NUCLED_MAX_LEDS];
+
+static int nuc_led_cdev_brightness_set(struct led_classdev *cdev,
+				       enum led_brightness brightness)
+{
+	struct led_classdev_mc *mc_cdev = lcdev_to_mccdev(cdev);
+	struct nuc_led_classdev *nled =
+		container_of(mc_cdev, struct nuc_led_classdev, mc_cdev);
+	u8 rgb[3];
+	int i, ret;
+
+	for (i = 0; i < 3; i++)
+		rgb[i] = min_t(unsigned int, nled->subleds[i].intensity, 255);
+
+	nuc_led_state_lock();
+	ret = nuc_led_set_software_color(
+		nled->led_type, DIV_ROUND_CLOSEST(brightness * 100, LED_FULL),
+		rgb[0], rgb[1], rgb[2], false);
+	nuc_led_state_unlock();
+
+	return ret;
+}
+
+static void nuc_led_register_classdevs(struct device *parent)
+{
+	static const int color_ids[] = { LED_COLOR_ID_RED, LED_COLOR_ID_GREEN,
+					 LED_COLOR_ID_BLUE };
+	struct nuc_led_classdev *nled;
+	struct software_indicator *software_ind;
+	u8 led_types[NUCLED_MAX_LEDS];
+	u8 colors[NUCLED_MAX_LEDS][3];
+	int i, c, n = 0;
+
+	// Collect the candidates under the lock, register without it
+	nuc_led_state_lock();
+	if (nuc_led_get_cached_leds() > 0) {
+		for (i = 0; i < num_leds && n < NUCLED_MAX_LEDS; i++) {
+			if (!leds[i].led_color_type.rgb ||
+			    !(leds[i].usage_type &
+			      BIT(NUCLED_USAGE_TYPE_SOFTWARE)))
+				continue;
+
+			colors[n][0] = colors[n][1] = colors[n][2] = 255;
+			if (leds[i].indicator_option ==
+				    NUCLED_USAGE_TYPE_SOFTWARE &&
+			    leds[i].indicator_valid) {
+				software_ind = &leds[i].indicator.software;
+				colors[n][0] = software_ind->led.color.red;
+				colors[n][1] = software_ind->led.color.green;
+				colors[n][2] = software_ind->led.color.blue;
+			}
+			led_types[n++] = leds[i].led_type;
+		}
+	}
+	nuc_led_state_unlock();
+
+	for (i = 0; i < n; i++) {
+		if (led_types[i] >= ARRAY_SIZE(led_short_names))
+			continue;
+
+		nled = kzalloc(sizeof(*nled), GFP_KERNEL);
+		if (!nled)
+			break;
+
+		nled->led_type = led_types[i];
+		snprintf(nled->name, sizeof(nled->name), "nuc:rgb:%s",
+			 led_short_names[nled->led_type]);
+		for (c = 0; c < 3; c++) {
+			nled->subleds[c].color_index = color_ids[c];
+			nled->subleds[c].intensity = colors[i][c];
+		}
+		nled->mc_cdev.subled_info = nled->subleds;
+		nled->mc_cdev.num_colors = 3;
+		nled->mc_cdev.led_cdev.name = nled->name;
+		nled->mc_cdev.led_cdev.max_brightness = LED_FULL;
+		nled->mc_cdev.led_cdev.brightness_set_blocking =
+			nuc_led_cdev_brightness_set;
+
+		if (led_classdev_mc_register(parent, &nled->mc_cdev)) {
+			pr_warn("Unable to register LED class device %s\n",
+				nled->name);
+			kfree(nled);
+			continue;
+		}
+		nuc_led_cdevs[nled->led_type] = nled;
+	}
+}
+
+static void nuc_led_unregister_classdevs(void)
+{
+	int i;
+
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		if (!nuc_led_cdevs[i])
+			continue;
+		led_classdev_mc_unregister(&nuc_led_cdevs[i]->mc_cdev);
+		kfree(nuc_led_cdevs[i]);
+		nuc_led_cdevs[i] = NULL;
+	}
+}
+#else
+static void nuc_led_register_classdevs(struct device *parent)
+{
+}
+
+static void nuc_led_unregister_classdevs(void)
+{
+}
+#endif
+
+/*
+ * sysfs tree, /sys/kernel/nuc_led/<led>/<indicator>/<field>, with one
+ * attribute per item of every indicator an LED supports, named after the
+ * fields of the indicator layouts. Reads of the current indicator are
+ * served from the published snapshot, others from the LED cache, which
+ * reads the whole indicator from firmware the first time. Writes set one
+ * item, exactly like set_indicator_value. <led>/indicator shows and
+ * selects the current indicator by name.
+ */
+struct nuc_led_field_attr {
+	struct kobj_attribute kattr;
+	u8 led_id;
+	u8 indicator_id; /* NUCLED_NO_ITEM for <led>/indicator */
+	u8 item_id;
+};
+
+static struct nuc_led_sysfs_led {
+	struct kobject *kobj;
+	struct nuc_led_field_attr indicator_attr;
+	struct kobject *indicator_kobjs[NUCLED_NUM_INDICATORS];
+	struct nuc_led_field_attr *fields[NUCLED_NUM_INDICATORS];
+	struct attribute **attrs[NUCLED_NUM_INDICATORS];
+} nuc_led_sysfs_leds[NUCLED_MAX_LEDS];
+
+static struct kobject *nuc_led_sysfs_root;
+
+/*
+ * Read one item, from the snapshot if it is the current indicator's and
+ * otherwise from the cache, which reads the whole indicator the first time.
+ */
+static int nuc_led_read_item(u8 led_id, u8 indicator_id, u8 item_id, u8 *value)
+{
+	struct nuc_led_ioc_indicator ind = {
+		.led_type = led_id,
+		.indicator_option = indicator_id,
+		.size = nuc_led_indicator_size(indicator_id),
+	};
+	int ret;
+
+	ret = nuc_led_populate();
+	if (ret)
+		return ret;
+
+	if (nuc_led_snapshot_indicator(&ind)) {
+		trace_nuc_led_cache_hit(led_id, indicator_id, item_id);
+		*value = ind.values[item_id];
+		return 0;
 	}
 
-	// Always returns a buffer
-	obj = (union acpi_object *)output.pointer;
+	nuc_led_state_lock();
+	ret = nuc_led_get_cached_leds();
+	if (ret < 0)
+		goto out;
+	ret = 0;
 
-	led->led_type = led_id;
-	led->name = led_names[led_id];
-	led->led_color_type.flags = obj->buffer.pointer[1];
+	if (nuc_led_cached_item(led_id, indicator_id, item_id, value)) {
+		trace_nuc_led_cache_hit(led_id, indicator_id, item_id);
+		goto out;
+	}
 
-	// pr_info("LED %i (%s) - Color type blue_amber %i, blue_white %i, rgb %i", led_id, led->name, led->led_color_type.blue_amber, led->led_color_type.blue_white, led->led_color_type.rgb);
+	trace_nuc_led_cache_miss(led_id, indicator_id, item_id);
+	ret = nuc_led_cache_other_indicator(led_id, indicator_id);
+	if (!ret && !nuc_led_cached_item(led_id, indicator_id, item_id, value))
+		ret = -ENODATA;
+out:
+	nuc_led_state_unlock();
+	return ret;
+}
 
-	args.arg1 = NUCLED_WMI_METHODARG_QUERYINDICATORSUPPORT;
+static ssize_t nuc_led_field_show(struct kobject *kobj,
+				  struct kobj_attribute *kattr, char *buf)
+{
+	struct nuc_led_field_attr *fattr =
+		container_of(kattr, struct nuc_led_field_attr, kattr);
+	u8 value;
+	int ret;
 
-	// Per Intel docs, first instance is used (instance is indexed from 0)
-	status = wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0,
-				     NUCLED_WMI_METHODID_QUERYLED, &input,
-				     &output);
+	ret = nuc_led_read_item(fattr->led_id, fattr->indicator_id,
+				fattr->item_id, &value);
+	if (ret)
+		return ret;
 
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
-		return -EIO;
-	}
+	return sprintf(buf, "%u\n", value);
+}
 
-	obj = (union acpi_object *)output.pointer;
-	led->usage_type = obj->buffer.pointer[1];
+static ssize_t nuc_led_field_store(struct kobject *kobj,
+				   struct kobj_attribute *kattr,
+				   const char *buf, size_t count)
+{
+	struct nuc_led_field_attr *fattr =
+		container_of(kattr, struct nuc_led_field_attr, kattr);
+	struct nuc_led_cmd cmd = {
+		.action = NUCLED_PROC_SETINDICATOROPTIONVALUE,
+		.led_id = fattr->led_id,
+		.indicator_id = fattr->indicator_id,
+		.num_args = 2,
+		.args = { fattr->item_id },
+	};
+	int ret;
 
-	// pr_info("LED %i - Got power_state %i, hdd_activity %i, ethernet %i, wifi %i, software %i, power_limit %i, disable %i", led_id, led->usage_type.power_state, led->usage_type.hdd_activity, led->usage_type.ethernet, led->usage_type.wifi, led->usage_type.software, led->usage_type.power_limit, led->usage_type.disable);
+	ret = kstrtou8(buf, 0, &cmd.args[1]);
+	if (ret)
+		return ret;
 
-	args.arg1 = NUCLED_WMI_METHODARG_GETCURRENTINDICATOR;
+	nuc_led_state_lock();
+	ret = nuc_led_exec_cmd(&cmd);
+	nuc_led_state_unlock();
 
-	// Per Intel docs, first instance is used (instance is indexed from 0)
-	status = wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0,
-				     NUCLED_WMI_METHODID_NEWGETLEDSTATUS,
-				     &input, &output);
+	return ret ? ret : count;
+}
 
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
-		return -EIO;
+static ssize_t nuc_led_indicator_show(struct kobject *kobj,
+				      struct kobj_attribute *kattr, char *buf)
+{
+	struct nuc_led_field_attr *fattr =
+		container_of(kattr, struct nuc_led_field_attr, kattr);
+	struct nuc_led_snapshot *snap;
+	const char *name = NULL;
+	int i, ret;
+
+	ret = nuc_led_populate();
+	if (ret)
+		return ret;
+
+	rcu_read_lock();
+	snap = rcu_dereference(nuc_led_snapshot);
+	for (i = 0; snap && i < snap->num_leds; i++) {
+		if (snap->leds[i].led_type == fattr->led_id) {
+			name = nuc_led_indicator_name(
+				snap->leds[i].indicator_option);
+			break;
+		}
 	}
+	rcu_read_unlock();
 
-	obj = (union acpi_object *)output.pointer;
-	led->indicator_option = obj->buffer.pointer[1];
+	if (!name)
+		return -ENODATA;
+	return sprintf(buf, "%s\n", name);
+}
 
-	// pr_info("LED %i - Got indicator option %i", led_id, obj->buffer.pointer[1]);
+static ssize_t nuc_led_indicator_store(struct kobject *kobj,
+				       struct kobj_attribute *kattr,
+				       const char *buf, size_t count)
+{
+	struct nuc_led_field_attr *fattr =
+		container_of(kattr, struct nuc_led_field_attr, kattr);
+	struct nuc_led_cmd cmd = {
+		.action = NUCLED_PROC_SET_INDICATOR,
+		.led_id = fattr->led_id,
+	};
+	const char *name;
+	int ret;
 
-	kfree(obj);
+	for (cmd.indicator_id = 0;
+	     cmd.indicator_id <= NUCLED_USAGE_TYPE_DISABLE; cmd.indicator_id++) {
+		name = nuc_led_indicator_name(cmd.indicator_id);
+		if (name && sysfs_streq(buf, name))
+			break;
+	}
+	if (cmd.indicator_id > NUCLED_USAGE_TYPE_DISABLE)
+		return -EINVAL;
 
-	nuc_led_fill_indicator_values(led);
+	nuc_led_state_lock();
+	ret = nuc_led_exec_cmd(&cmd);
+	nuc_led_state_unlock();
 
-	return 0;
+	return ret ? ret : count;
 }
 
-/* Get LEDs */
-static int nuc_led_get_leds(void)
+static void nuc_led_init_attr(struct nuc_led_field_attr *fattr,
+			      const char *name, u8 led_id, u8 indicator_id,
+			      u8 item_id)
 {
-	struct acpi_args args = { .arg1 = 0 };
-	struct acpi_buffer input;
-	struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
-	union acpi_object *obj;
-	acpi_status status;
+	sysfs_attr_init(&fattr->kattr.attr);
+	fattr->kattr.attr.name = name;
+	fattr->kattr.attr.mode = 0644;
+	fattr->led_id = led_id;
+	fattr->indicator_id = indicator_id;
+	fattr->item_id = item_id;
+	if (indicator_id == NUCLED_NO_ITEM) {
+		fattr->kattr.show = nuc_led_indicator_show;
+		fattr->kattr.store = nuc_led_indicator_store;
+	} else {
+		fattr->kattr.show = nuc_led_field_show;
+		fattr->kattr.store = nuc_led_field_store;
+	}
+}
 
-	LED_TYPES led_types;
-	int flags, i, o = 0, num_leds;
+/* Create <led>/<indicator> with one attribute per field */
+static int nuc_led_sysfs_add_indicator(struct nuc_led_sysfs_led *sled,
+				       u8 led_id, u8 indicator_id)
+{
+	const struct nuc_led_indicator_layout *layout =
+		&nuc_led_indicator_layouts[indicator_id];
+	struct attribute_group group = {};
+	struct nuc_led_field_attr *fields;
+	struct attribute **attrs;
+	struct kobject *kobj;
+	int i, ret;
+
+	fields = kcalloc(layout->num_fields, sizeof(*fields), GFP_KERNEL);
+	attrs = kcalloc(layout->num_fields + 1, sizeof(*attrs), GFP_KERNEL);
+	kobj = kobject_create_and_add(layout->name, sled->kobj);
+	if (!fields || !attrs || !kobj) {
+		ret = -ENOMEM;
+		goto err;
+	}
 
-	input.length = (acpi_size)sizeof(args);
-	input.pointer = &args;
+	for (i = 0; i < layout->num_fields; i++) {
+		nuc_led_init_attr(&fields[i], layout->fields[i].name, led_id,
+				  indicator_id, layout->fields[i].item_id);
+		attrs[i] = &fields[i].kattr.attr;
+	}
+	group.attrs = attrs;
 
-	// Per Intel docs, first instance is used (instance is indexed from 0)
-	status = wmi_evaluate_method(NUCLED_WMI_MGMT_GUID, 0,
-				     NUCLED_WMI_METHODID_QUERYLED, &input,
-				     &output);
+	ret = sysfs_create_group(kobj, &group);
+	if (ret)
+		goto err;
 
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
-		return -EIO;
-	}
+	sled->indicator_kobjs[indicator_id] = kobj;
+	sled->fields[indicator_id] = fields;
+	sled->attrs[indicator_id] = attrs;
+	return 0;
 
-	// Always returns a buffer
-	obj = (union acpi_object *)output.pointer;
-	flags = led_types.flags = obj->buffer.pointer[1];
+err:
+	kobject_put(kobj);
+	kfree(attrs);
+	kfree(fields);
+	return ret;
+}
 
-	// pr_info("Got pwr %i, hdd %i, skull %i, eyes %i, front1 %i, front2 %i, front3 %i", led_types.power, led_types.hdd, led_types.skull, led_types.eyes, led_types.front1, led_types.front2, led_types.front3);
+static void nuc_led_unregister_sysfs(void)
+{
+	struct nuc_led_sysfs_led *sled;
+	int i, j;
+
+	for (i = 0; i < NUCLED_MAX_LEDS; i++) {
+		sled = &nuc_led_sysfs_leds[i];
+		for (j = 0; j < NUCLED_NUM_INDICATORS; j++) {
+			kobject_put(sled->indicator_kobjs[j]);
+			kfree(sled->attrs[j]);
+			kfree(sled->fields[j]);
+		}
+		kobject_put(sled->kobj);
+		memset(sled, 0, sizeof(*sled));
+	}
 
-	num_leds = countSetBits(led_types.flags);
-	// pr_info("Num leds: %i", num_leds);
-	leds = vmalloc(sizeof(LED_INFO) * num_leds);
+	kobject_put(nuc_led_sysfs_root);
+	nuc_led_sysfs_root = NULL;
+}
 
-	for (i = 0; i < 8; i++) {
-		if (flags & 0x01) {
-			nuc_led_get_led(i, &leds[o++]);
+/* Build the tree from the LEDs' capabilities, called once they are known */
+static void nuc_led_register_sysfs(void)
+{
+	struct nuc_led_sysfs_led *sled;
+	u8 led_types[NUCLED_MAX_LEDS], usage_types[NUCLED_MAX_LEDS];
+	int i, j, n = 0;
+
+	nuc_led_state_lock();
+	if (nuc_led_caps_known) {
+		for (i = 0; i < num_leds; i++) {
+			led_types[n] = leds[i].led_type;
+			usage_types[n++] = leds[i].usage_type;
+		}
+	}
+	nuc_led_state_unlock();
+
+	if (!n)
+		return;
+
+	nuc_led_sysfs_root = kobject_create_and_add("nuc_led", kernel_kobj);
+	if (!nuc_led_sysfs_root)
+		goto err;
+
+	for (i = 0; i < n; i++) {
+		if (led_types[i] >= ARRAY_SIZE(led_short_names))
+			continue;
+
+		sled = &nuc_led_sysfs_leds[led_types[i]];
+		sled->kobj = kobject_create_and_add(
+			led_short_names[led_types[i]], nuc_led_sysfs_root);
+		if (!sled->kobj)
+			goto err;
+
+		nuc_led_init_attr(&sled->indicator_attr, "indicator",
+				  led_types[i], NUCLED_NO_ITEM, NUCLED_NO_ITEM);
+		if (sysfs_create_file(sled->kobj,
+				      &sled->indicator_attr.kattr.attr))
+			goto err;
+
+		for (j = 0; j < NUCLED_NUM_INDICATORS; j++) {
+			if (!(usage_types[i] & BIT(j)))
+				continue;
+			if (nuc_led_sysfs_add_indicator(sled, led_types[i], j))
+				goto err;
 		}
-		flags = flags >> 1;
 	}
+	return;
 
-	kfree(obj);
+err:
+	pr_warn("Intel NUC LED control driver could not create /sys/kernel/nuc_led\n");
+	nuc_led_unregister_sysfs();
+}
 
-	return num_leds;
+/*
+ * Suspend and resume. The firmware keeps the selected indicators and
+ * their values across sleep, except the ones in NUCLED_PM_VOLATILE_INDICATORS.
+ * Before suspending, queued writes are drained and the cache is saved;
+ * after resuming, a work item reads back the current indicators and the
+ * values of volatile ones, and writes only what differs from what was
+ * saved. Resuming doesn't wait for it; writes that come in meanwhile win
+ * over the saved state of their LED.
+ */
+static LED_INFO nuc_led_pm_saved[NUCLED_MAX_LEDS];
+static int nuc_led_pm_num_saved;
+
+static struct {
+	u64 suspends;
+	u64 restores;
+	u64 reads;
+	u64 writes;
+	u64 failed;
+	u64 last_us;
+	u64 max_us;
+	u64 total_us;
+} nuc_led_pm_stats;
+
+static void nuc_led_pm_restore(struct work_struct *work);
+static DECLARE_WORK(nuc_led_pm_work, nuc_led_pm_restore);
+
+static void nuc_led_pm_save(void)
+{
+	// Let queued and rate limited writes reach firmware first
+	nuc_led_state_lock();
+	nuc_led_queue_flushing = true;
+	nuc_led_state_unlock();
+	flush_delayed_work(&nuc_led_queue_work);
+
+	nuc_led_state_lock();
+	nuc_led_queue_flushing = false;
+	nuc_led_pm_num_saved = leds_cached ? num_leds : 0;
+	memcpy(nuc_led_pm_saved, leds, sizeof(nuc_led_pm_saved));
+	nuc_led_pm_stats.suspends++;
+	if (nuc_led_backend->suspend)
+		nuc_led_backend->suspend();
+	nuc_led_state_unlock();
 }
 
-static int nuc_led_set_indicator(u8 led_id, u8 indicator_id)
+/* Bring one LED back to its saved state, returns the number of WMI writes */
+static int nuc_led_pm_restore_led(const LED_INFO *saved)
 {
-	struct acpi_args args = { .arg1 = led_id, .arg2 = indicator_id };
-	struct acpi_buffer input;
-	struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
-	acpi_status status;
+	u8 led_id = saved->led_type;
+	u8 indicator_id = saved->indicator_option;
+	int i, size, writes = 0;
+	u8 value;
 
-	input.length = (acpi_size)sizeof(args);
-	input.pointer = &args;
+	nuc_led_pm_stats.reads++;
+	if (nuc_led_get_current_indicator(led_id, &value))
+		return -EIO;
+	if (value != indicator_id) {
+		writes++;
+		if (nuc_led_fw_set_indicator(led_id, indicator_id))
+			return -EIO;
+	}
 
-	status = wmi_evaluate_method(
-		NUCLED_WMI_MGMT_GUID, 0,
-		NUCLED_WMI_METHODID_SETINDICATOROPTIONLEDTYPE, &input, &output);
+	if (!saved->indicator_valid ||
+	    !(NUCLED_PM_VOLATILE_INDICATORS & BIT(indicator_id)))
+		return writes;
 
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
-		return -EIO;
+	size = nuc_led_indicator_size(indicator_id);
+	for (i = 0; i < size; i++) {
+		nuc_led_pm_stats.reads++;
+		if (nuc_led_get_indicator_item(led_id, indicator_id, i, &value))
+			return -EIO;
+		if (value == saved->indicator.raw[i])
+			continue;
+		writes++;
+		if (nuc_led_fw_set_item(led_id, indicator_id, i,
+					saved->indicator.raw[i]))
+			return -EIO;
 	}
-	return 0;
+	return writes;
 }
 
-static int nuc_led_set_indicator_option(u8 led_id, u8 indicator_id, u8 item_id,
-					u8 value)
+static void nuc_led_pm_restore(struct work_struct *work)
 {
-	struct acpi_args args = { .arg1 = led_id,
-				  .arg2 = indicator_id,
-				  .arg3 = item_id,
-				  .arg4 = value };
-	struct acpi_buffer input;
-	struct acpi_buffer output = { ACPI_ALLOCATE_BUFFER, NULL };
-	acpi_status status;
-
-	input.length = (acpi_size)sizeof(args);
-	input.pointer = &args;
-
-	// Per Intel docs, first instance is used (instance is indexed from 0)
-	status = wmi_evaluate_method(
-		NUCLED_WMI_MGMT_GUID, 0,
-		NUCLED_WMI_METHODID_SETVALUEINDICATOROPTIONLEDTYPE, &input,
-		&output);
-
-	if (ACPI_FAILURE(status)) {
-		ACPI_EXCEPTION((AE_INFO, status, "wmi_evaluate_method"));
-		return -EIO;
+	ktime_t start = ktime_get();
+	int i, ret;
+	u64 us;
+
+	nuc_led_state_lock();
+	// Only current indicators are restored, the others are read again
+	for (i = 0; i < num_leds; i++)
+		leds[i].others_valid = 0;
+
+	for (i = 0; i < nuc_led_pm_num_saved; i++) {
+		if (nuc_led_pm_written & BIT(nuc_led_pm_saved[i].led_type))
+			continue;
+
+		ret = nuc_led_pm_restore_led(&nuc_led_pm_saved[i]);
+		if (ret < 0) {
+			pr_warn("Could not restore Intel NUC LED %s after resume\n",
+				nuc_led_pm_saved[i].name);
+			nuc_led_pm_stats.failed++;
+			// Don't trust the cache for what firmware holds now
+			leds_cached = false;
+			continue;
+		}
+		nuc_led_pm_stats.writes += ret;
 	}
-	return 0;
+
+	us = div_u64(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     NSEC_PER_USEC);
+	nuc_led_pm_stats.restores++;
+	nuc_led_pm_stats.last_us = us;
+	nuc_led_pm_stats.max_us = max(nuc_led_pm_stats.max_us, us);
+	nuc_led_pm_stats.total_us += us;
+	nuc_led_state_unlock();
 }
 
-static ssize_t acpi_proc_write(struct file *filp, const char __user *buff,
-			       size_t len, loff_t *data)
+static int nuc_led_pm_notify(struct notifier_block *nb, unsigned long action,
+			     void *data)
 {
-	int i = 0;
-	int ret = 0;
-	char *input, *arg, *sep;
-	static int status = 0;
-	u8 action, led_id, indicator_id, indicator_setting, setting_value;
+	switch (action) {
+	case PM_SUSPEND_PREPARE:
+	case PM_HIBERNATION_PREPARE:
+		// A restore still running would save a half restored state
+		flush_work(&nuc_led_pm_work);
+		nuc_led_pm_save();
+		break;
+	case PM_POST_SUSPEND:
+	case PM_POST_HIBERNATION:
+	case PM_POST_RESTORE:
+		nuc_led_state_lock();
+		nuc_led_pm_written = 0;
+		nuc_led_state_unlock();
+		schedule_work(&nuc_led_pm_work);
+		break;
+	}
+	return NOTIFY_DONE;
+}
 
-	// Move buffer from user space to kernel space
-	input = vmalloc(len);
-	if (!input)
-		return -ENOMEM;
+static struct notifier_block nuc_led_pm_nb = {
+	.notifier_call = nuc_led_pm_notify,
+};
 
-	if (copy_from_user(input, buff, len))
-		return -EFAULT;
+/*
+ * Stress mode: writing "<readers> <writers> <seconds>" to debugfs
+ * nuc_led/stress runs that many reader and writer threads for a while.
+ * Readers copy the published snapshot like NUCLED_IOC_GET_LEDS; writers
+ * take nuc_led_lock and republish the cache, without firmware calls.
+ * The write returns when the run is over, results add up in stats.
+ */
+#define NUCLED_STRESS_MAX_THREADS 64
+#define NUCLED_STRESS_MAX_SECONDS 60
 
-	// Strip new line
-	input[len] = '\0';
-	if (input[len - 1] == '\n')
-		input[len - 1] = '\0';
+static DEFINE_MUTEX(nuc_led_stress_lock);
+static atomic64_t nuc_led_stress_reads = ATOMIC64_INIT(0);
+static atomic64_t nuc_led_stress_writes = ATOMIC64_INIT(0);
 
-	// Parse input string
-	sep = input;
-	while ((arg = strsep(&sep, ",")) && *arg) {
-		switch (i) {
-		case 0: // First arg: operation ("set_indicator" or "set_indicator_value")
-			if (!strcmp(arg, "set_indicator")) {
-				action = NUCLED_PROC_SET_INDICATOR;
-			} else if (!strcmp(arg, "set_indicator_value")) {
-				action = NUCLED_PROC_SETINDICATOROPTIONVALUE;
-			} else {
-				pr_warn("Invalid action (%s) while setting NUC LED state\n",
-					arg);
-				ret = -EINVAL;
-			}
-			break;
+static int nuc_led_stress_reader(void *data)
+{
+	struct nuc_led_ioc_led *copy = data;
+	struct nuc_led_snapshot *snap;
+
+	while (!kthread_should_stop()) {
+		rcu_read_lock();
+		snap = rcu_dereference(nuc_led_snapshot);
+		if (snap)
+			memcpy(copy, snap->leds, sizeof(snap->leds));
+		rcu_read_unlock();
+
+		atomic64_inc(&nuc_led_stress_reads);
+		cond_resched();
+	}
 
-		case 1: // Second arg: LED ID
-			if (kstrtou8(arg, 0, &led_id)) {
-				pr_warn("Invalid LED ID (%s) while setting NUC LED state\n",
-					arg);
-				ret = -EINVAL;
-			}
-			break;
+	return 0;
+}
 
-		case 2: // Third arg: indicator id
-			if (kstrtou8(arg, 0, &indicator_id)) {
-				pr_warn("Invalid indicator ID (%s) while setting NUC LED state\n",
-					arg);
-				ret = -EINVAL;
-			}
-			break;
+static int nuc_led_stress_writer(void *data)
+{
+	while (!kthread_should_stop()) {
+		nuc_led_state_lock();
+		leds_dirty = leds_cached;
+		nuc_led_state_unlock();
 
-		case 3: // Fourth arg (for set_indicator_value): indicator setting
-			if (action == NUCLED_PROC_SET_INDICATOR) {
-				pr_warn("Too many arguments for action set_indicator while setting NUC LED state\n");
-				ret = -EOVERFLOW;
-				break;
-			}
-			if (kstrtou8(arg, 0, &indicator_setting)) {
-				pr_warn("Invalid indicator setting (%s) while setting NUC LED state\n",
-					arg);
-				ret = -EINVAL;
-			}
-			break;
+		atomic64_inc(&nuc_led_stress_writes);
+		cond_resched();
+	}
 
-		case 4: // Fifth arg (for set_indicator_value): indicator setting value
-			if (action == NUCLED_PROC_SET_INDICATOR) {
-				pr_warn("Too many arguments for action set_indicator while setting NUC LED state\n");
-				ret = -EOVERFLOW;
-				break;
-			}
-			if (kstrtou8(arg, 0, &setting_value)) {
-				pr_warn("Invalid indicator setting (%s) while setting NUC LED state\n",
-					arg);
-				ret = -EINVAL;
-			}
-			break;
+	return 0;
+}
 
-		default: // Too many args!
-			pr_warn("Too many arguments while setting NUC LED state\n");
-			ret = -EOVERFLOW;
-			break;
-		}
+static int nuc_led_stress_run(unsigned int readers, unsigned int writers,
+			      unsigned int seconds)
+{
+	struct nuc_led_ioc_led(*copies)[NUCLED_MAX_LEDS];
+	struct task_struct **threads;
+	unsigned int i, n = 0;
+	int ret;
+
+	ret = nuc_led_populate();
+	if (ret)
+		return ret;
+
+	// The readers' buffers outlive threads stopped before they ran
+	threads = kcalloc(readers + writers, sizeof(*threads), GFP_KERNEL);
+	copies = kcalloc(readers, sizeof(*copies), GFP_KERNEL);
+	if (!threads || (readers && !copies)) {
+		kfree(threads);
+		kfree(copies);
+		return -ENOMEM;
+	}
 
-		if (ret != 0) {
+	for (i = 0; i < readers + writers; i++) {
+		if (i < readers)
+			threads[i] = kthread_run(nuc_led_stress_reader,
+						 copies[i], "nuc_led_stress/r%u",
+						 i);
+		else
+			threads[i] = kthread_run(nuc_led_stress_writer, NULL,
+						 "nuc_led_stress/w%u",
+						 i - readers);
+		if (IS_ERR(threads[i])) {
+			ret = PTR_ERR(threads[i]);
 			break;
 		}
-
-		// Track iterations
-		i++;
+		n++;
 	}
 
-	vfree(input);
+	if (!ret)
+		msleep_interruptible(seconds * 1000);
 
-	if (ret == 0) {
-		if (i != 3 && action == NUCLED_PROC_SET_INDICATOR) {
-			pr_warn("Too few arguments (%d), needs 3, while setting NUC LED indicator\n",
-				i);
-			ret = -EINVAL;
-		}
+	for (i = 0; i < n; i++)
+		kthread_stop(threads[i]);
+	kfree(threads);
+	kfree(copies);
 
-		if (i != 5 && action == NUCLED_PROC_SETINDICATOROPTIONVALUE) {
-			pr_warn("Too few arguments (%d), needs 5, while setting NUC LED indicator\n",
-				i);
-			ret = -EINVAL;
-		}
-	}
+	return ret;
+}
 
-	if (ret != 0) {
-		return len;
-	}
+static ssize_t nuc_led_stress_write(struct file *file,
+				    const char __user *buff, size_t len,
+				    loff_t *ppos)
+{
+	unsigned int readers, writers, seconds;
+	char input[32];
+	int ret;
 
-	switch (action) {
-	case NUCLED_PROC_SET_INDICATOR:
-		pr_info("Setting LED %i indicator to %i\n", led_id,
-			indicator_id);
-		nuc_led_set_indicator(led_id, indicator_id);
-		break;
-	case NUCLED_PROC_SETINDICATOROPTIONVALUE:
-		pr_info("Setting LED %i indicator %i option %i to %i\n", led_id,
-			indicator_id, indicator_setting, setting_value);
-		nuc_led_set_indicator_option(led_id, indicator_id,
-					     indicator_setting, setting_value);
-		break;
-	}
+	if (len >= sizeof(input))
+		return -EINVAL;
+	if (copy_from_user(input, buff, len))
+		return -EFAULT;
+	input[len] = '\0';
 
-	/*
-	status = nuc_led_set_state(led, brightness, blink_fade, color_state, &retval);
-	if (status)
-	{
-		pr_warn("Unable to set NUC LED state: WMI call failed\n");
-	}
-	else
-	{
-		if (retval.brightness_return == NUCLED_WMI_RETURN_UNDEFINED)
-		{
-			if (led == NUCLED_WMI_POWER_LED_ID)
-				pr_warn("Unable set NUC power LED state: not set for SW control\n");
-			else if (led == NUCLED_WMI_RING_LED_ID)
-				pr_warn("Unable set NUC ring LED state: not set for SW control\n");
-		}
-		else if (retval.brightness_return == NUCLED_WMI_RETURN_BADPARAM || retval.blink_fade_return == NUCLED_WMI_RETURN_BADPARAM ||
-				retval.color_return == NUCLED_WMI_RETURN_BADPARAM)
-		{
-			pr_warn("Unable to set NUC LED state: invalid parameter\n");
-		}
-		else if (retval.brightness_return != NUCLED_WMI_RETURN_SUCCESS)
-		{
-			pr_warn("Unable to set NUC LED state: WMI call returned error (0x%02x)\n", retval.brightness_return);
-		}
-	}*/
+	if (sscanf(input, "%u %u %u", &readers, &writers, &seconds) != 3 ||
+	    readers > NUCLED_STRESS_MAX_THREADS ||
+	    writers > NUCLED_STRESS_MAX_THREADS || !(readers + writers) ||
+	    !seconds || seconds > NUCLED_STRESS_MAX_SECONDS)
+		return -EINVAL;
 
-	return len;
-}
+	if (!mutex_trylock(&nuc_led_stress_lock))
+		return -EBUSY;
+	ret = nuc_led_stress_run(readers, writers, seconds);
+	mutex_unlock(&nuc_led_stress_lock);
 
-static void print_color(LED_RGB *rgb)
-{
-	sprintf(get_buffer_end(), "rgb(%d,%d,%d)", rgb->red, rgb->green,
-		rgb->blue);
+	return ret ? ret : len;
 }
 
-static void print_blink_led(BLINK_LED *led)
+/* Driver statistics in debugfs */
+static struct dentry *nuc_led_debugfs;
+
+static int nuc_led_stats_show(struct seq_file *m, void *v)
 {
-	sprintf(get_buffer_end(), "%d%% %s ", led->brightness,
-		led_blink_behaviors[led->blink_behavior]);
-	print_color(&led->color);
-	sprintf(get_buffer_end(), " (%d dHz)", led->blink_freq);
+	nuc_led_state_lock();
+	seq_printf(m, "queue_submitted: %llu\n",
+		   nuc_led_queue_stats.submitted);
+	seq_printf(m, "queue_coalesced: %llu\n",
+		   nuc_led_queue_stats.coalesced);
+	seq_printf(m, "queue_executed: %llu\n", nuc_led_queue_stats.executed);
+	seq_printf(m, "queue_failed: %llu\n", nuc_led_queue_stats.failed);
+	seq_printf(m, "rate_deferred: %llu\n", nuc_led_queue_stats.deferred);
+	seq_printf(m, "rate_dropped: %llu\n", nuc_led_queue_stats.dropped);
+	seq_printf(m, "snapshot_generation: %llu\n", nuc_led_generation);
+	seq_printf(m, "snapshot_allocs: %llu\n", nuc_led_snapshot_allocs);
+	seq_printf(m, "color_updates: %llu\n", nuc_led_color_stats.updates);
+	seq_printf(m, "color_suppressed: %llu\n",
+		   nuc_led_color_stats.suppressed);
+	seq_printf(m, "color_writes_saved: %llu\n",
+		   nuc_led_color_stats.writes_saved);
+	seq_printf(m, "pm_suspends: %llu\n", nuc_led_pm_stats.suspends);
+	seq_printf(m, "pm_restores: %llu\n", nuc_led_pm_stats.restores);
+	seq_printf(m, "pm_restore_reads: %llu\n", nuc_led_pm_stats.reads);
+	seq_printf(m, "pm_restore_writes: %llu\n", nuc_led_pm_stats.writes);
+	seq_printf(m, "pm_restore_failed: %llu\n", nuc_led_pm_stats.failed);
+	seq_printf(m, "pm_restore_last_us: %llu\n", nuc_led_pm_stats.last_us);
+	seq_printf(m, "pm_restore_max_us: %llu\n", nuc_led_pm_stats.max_us);
+	seq_printf(m, "pm_restore_total_us: %llu\n",
+		   nuc_led_pm_stats.total_us);
+	nuc_led_state_unlock();
+
+	seq_printf(m, "lock_contended: %lld\n",
+		   atomic64_read(&nuc_led_lock_contended));
+	seq_printf(m, "change_uevents: %lld\n",
+		   atomic64_read(&nuc_led_uevents_sent));
+	seq_printf(m, "stress_reads: %lld\n",
+		   atomic64_read(&nuc_led_stress_reads));
+	seq_printf(m, "stress_writes: %lld\n",
+		   atomic64_read(&nuc_led_stress_writes));
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(nuc_led_stats);
 
-static void print_flash_led(FLASH_LED *led)
+static void nuc_led_wmi_sum(u32 method_id, struct nuc_led_wmi_stats *sum)
 {
-	sprintf(get_buffer_end(), "%d%% ", led->brightness);
-	print_color(&led->color);
+	const struct nuc_led_wmi_stats *st;
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		st = &per_cpu(nuc_led_wmi_counters, cpu)[method_id];
+		sum->calls += st->calls;
+		sum->errors += st->errors;
+		for (i = 0; i < NUCLED_WMI_NUM_RETURNS; i++)
+			sum->returns[i] += st->returns[i];
+		for (i = 0; i < NUCLED_WMI_LATENCY_BUCKETS; i++)
+			sum->latency[i] += st->latency[i];
+	}
 }
 
-static void print_led(LED_INFO *led)
+/*
+ * One block per method that was called: return codes, then the latency
+ * histogram, where bucket "<N" counts calls shorter than N microseconds
+ * (and at least half of that).
+ */
+static int nuc_led_wmi_show(struct seq_file *m, void *v)
 {
+	struct nuc_led_wmi_stats sum;
+	u32 method_id;
 	int i;
-	struct power_state_indicator *power_state_ind;
-	struct hdd_activity_indicator *hdd_activity_ind;
-	struct ethernet_indicator *ethernet_ind;
-	struct wifi_indicator *wifi_ind;
-	struct software_indicator *software_ind;
-	struct power_limit_indicator *power_limit_ind;
 
-	sprintf(get_buffer_end(), "LED %i (%s) - Color type: %s\n",
-		led->led_type, led->name,
-		led_color_types[bitIndexToIndex(led->led_color_type.flags)]);
-
-	sprintf(get_buffer_end(), "  Supported indicators: ");
-	for (i = 1; i <= 128; i = i << 1) {
-		if (led->usage_type & i) {
-			sprintf(get_buffer_end(), "%s  ",
-				led_usage_types[bitIndexToIndex(i)]);
+	for (method_id = 0; method_id < NUCLED_WMI_NUM_METHODS; method_id++) {
+		nuc_led_wmi_sum(method_id, &sum);
+		if (!sum.calls)
+			continue;
+
+		seq_printf(m, "%s: calls %llu errors %llu\n",
+			   nuc_led_wmi_methods[method_id], sum.calls,
+			   sum.errors);
+
+		seq_puts(m, "  returns:");
+		for (i = 0; i < ARRAY_SIZE(nuc_led_wmi_returns); i++)
+			seq_printf(m, " %s %llu", nuc_led_wmi_returns[i].name,
+				   sum.returns[i]);
+		seq_printf(m, " other %llu\n", sum.returns[i]);
+
+		seq_puts(m, "  latency_us:");
+		for (i = 0; i < NUCLED_WMI_LATENCY_BUCKETS - 1; i++) {
+			if (sum.latency[i])
+				seq_printf(m, " <%lu %llu", 1UL << i,
+					   sum.latency[i]);
 		}
+		if (sum.latency[i])
+			seq_printf(m, " >=%lu %llu", 1UL << (i - 1),
+				   sum.latency[i]);
+		seq_puts(m, "\n");
 	}
 
-	sprintf(get_buffer_end(), "\n  Current indicator: %s\n",
-		led_usage_types[led->indicator_option]);
-
-	switch (led->indicator_option) {
-	case NUCLED_USAGE_TYPE_POWER_STATE:
-		power_state_ind =
-			(struct power_state_indicator *)led->indicator;
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nuc_led_wmi);
 
-		sprintf(get_buffer_end(), "\n        S0 (On): ");
-		print_blink_led(&power_state_ind->s0);
-		sprintf(get_buffer_end(), "\n     S3 (Sleep): ");
-		print_blink_led(&power_state_ind->s3);
-		sprintf(get_buffer_end(), "\n     Ready mode: ");
-		print_blink_led(&power_state_ind->ready_mode);
-		sprintf(get_buffer_end(), "\n  S5 (Soft off): ");
-		print_blink_led(&power_state_ind->s5);
-		sprintf(get_buffer_end(), "\n");
-		break;
-	case NUCLED_USAGE_TYPE_HDD_ACTIVITY:
-		hdd_activity_ind =
-			(struct hdd_activity_indicator *)led->indicator;
-		sprintf(get_buffer_end(), "\n  HDD LED: ");
-		print_flash_led(&hdd_activity_ind->led);
-		sprintf(get_buffer_end(), " %s\n",
-			led_flash_behaviors[hdd_activity_ind->behavior]);
-		break;
-	case NUCLED_USAGE_TYPE_ETHERNET:
-		ethernet_ind =
-			(struct ethernet_indicator *)led->indicator;
-		sprintf(get_buffer_end(), "\n  Ethernet LED: ");
-		sprintf(get_buffer_end(), "%s  ",
-			led_ethernet_type[ethernet_ind->type]);
-		print_flash_led(&ethernet_ind->led);
-		sprintf(get_buffer_end(), "\n");
-		break;
-	case NUCLED_USAGE_TYPE_WIFI:
-		wifi_ind =
-			(struct wifi_indicator *)led->indicator;
-		sprintf(get_buffer_end(), "\n  Wifi LED: ");
-		print_flash_led(&wifi_ind->led);
-		sprintf(get_buffer_end(), "\n");
-		break;
-	case NUCLED_USAGE_TYPE_SOFTWARE:
-		software_ind =
-			(struct software_indicator *)led->indicator;
-		sprintf(get_buffer_end(), "\n  Software LED: ");
-		print_blink_led(&software_ind->led);
-		sprintf(get_buffer_end(), "\n");
-		break;
-	case NUCLED_USAGE_TYPE_POWER_LIMIT:
-		power_limit_ind =
-			(struct power_limit_indicator *)led->indicator;
-		sprintf(get_buffer_end(), "\n  Power Limit LED: ");
-		sprintf(get_buffer_end(), "%s  ",
-			led_power_limit_indication_scheme[power_limit_ind->indication_scheme]);
-		print_flash_led(&power_limit_ind->led);
-		sprintf(get_buffer_end(), "\n");
-		break;
-	default:
-		break;
+/* Stored presets, as the preset_add lines that recreate them */
+static int nuc_led_presets_show(struct seq_file *m, void *v)
+{
+	struct nuc_led_preset *preset;
+	struct nuc_led_preset_op *op;
+	int i, j;
+
+	nuc_led_state_lock();
+	for (i = 0; i < NUCLED_MAX_PRESETS; i++) {
+		preset = &nuc_led_presets[i];
+		for (j = 0; preset->name[0] && j < preset->num_ops; j++) {
+			op = &preset->ops[j];
+			seq_printf(m, "preset_add,%s,%u,%u", preset->name,
+				   op->led_id, op->indicator_id);
+			if (op->action == NUCLED_PROC_SETINDICATOROPTIONVALUE)
+				seq_printf(m, ",%u,%u", op->item_id,
+					   op->value);
+			seq_puts(m, "\n");
+		}
 	}
+	nuc_led_state_unlock();
+
+	return 0;
 }
+DEFINE_SHOW_ATTRIBUTE(nuc_led_presets);
 
-static ssize_t acpi_proc_read(struct file *filp, char __user *buff,
-			      size_t count, loff_t *off)
+static const struct file_operations nuc_led_stress_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.write = nuc_led_stress_write,
+};
+
+static void nuc_led_create_debugfs(void)
 {
-	ssize_t ret;
+	nuc_led_debugfs = debugfs_create_dir("nuc_led", NULL);
+	debugfs_create_file("stats", S_IRUSR, nuc_led_debugfs, NULL,
+			    &nuc_led_stats_fops);
+	debugfs_create_file("stress", S_IWUSR, nuc_led_debugfs, NULL,
+			    &nuc_led_stress_fops);
+	debugfs_create_file("wmi", S_IRUSR, nuc_led_debugfs, NULL,
+			    &nuc_led_wmi_fops);
+	debugfs_create_file("presets", S_IRUSR, nuc_led_debugfs, NULL,
+			    &nuc_led_presets_fops);
+}
 
-	int i, len = 0;
-	// Clear buffer
-	memset(result_buffer, 0, BUFFER_SIZE);
+/* Discover the LEDs and read their state, queued by init_nuc_led() */
+static void nuc_led_probe(struct work_struct *work)
+{
+	int ret;
 
-	int num_leds = nuc_led_get_leds();
+	nuc_led_state_lock();
+	ret = nuc_led_get_cached_leds();
+	nuc_led_state_unlock();
+	if (ret < 0)
+		pr_warn("Unable to probe Intel NUC LEDs (%d), retrying on first read\n",
+			ret);
 
-	for (i = 0; i < num_leds; i++) {
-		print_led(&leds[i]);
-		if (i + 1 < num_leds) {
-			sprintf(get_buffer_end(), "\n\n");
-		}
-	}
+	complete_all(&nuc_led_probed);
+}
 
-	// Return buffer via proc
-	len = strlen(result_buffer);
-	ret = simple_read_from_buffer(buff, count, off, result_buffer, len + 1);
+/* Register what depends on the capabilities, queued by nuc_led_get_caps() */
+static void nuc_led_register_devices(struct work_struct *work)
+{
+	if (nuc_led_devices_registered)
+		return;
+	nuc_led_devices_registered = true;
 
-	return ret;
+	// Let LED triggers drive the RGB LEDs
+	nuc_led_register_classdevs(nuc_led_miscdev.this_device);
+	nuc_led_register_sysfs();
 }
 
-static struct file_operations proc_acpi_operations = {
-	.owner = THIS_MODULE,
-	.read = acpi_proc_read,
-	.write = acpi_proc_write,
-};
-
 /* Init & unload */
 static int __init init_nuc_led(void)
 {
 	struct proc_dir_entry *acpi_entry;
+	int i, ret;
 	kuid_t uid;
 	kgid_t gid;
 
+	BUILD_BUG_ON(sizeof(INDICATOR_VALUES) > NUCLED_MAX_INDICATOR_SIZE);
+
+	for (i = 0; i < ARRAY_SIZE(nuc_led_backends); i++) {
+		if (!strcmp(backend, nuc_led_backends[i]->name))
+			nuc_led_backend = nuc_led_backends[i];
+	}
+	if (strcmp(backend, nuc_led_backend->name)) {
+		pr_warn("Unknown Intel NUC LED backend %s\n", backend);
+		return -EINVAL;
+	}
+
 	// Make sure LED control WMI GUID exists
-	if (!wmi_has_guid(NUCLED_WMI_MGMT_GUID)) {
+	if (nuc_led_backend == &nuc_led_wmi_backend &&
+	    !wmi_has_guid(NUCLED_WMI_MGMT_GUID)) {
 		pr_warn("Intel NUC LED WMI GUID not found\n");
 		return -ENODEV;
 	}
@@ -611,25 +3779,86 @@ static int __init init_nuc_led(void)
 		return -EINVAL;
 	}
 
+	// Page shared with userspace through mmap of /dev/nuc_led
+	BUILD_BUG_ON(sizeof(struct nuc_led_shared_state) > PAGE_SIZE);
+	nuc_led_shared = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!nuc_led_shared)
+		return -ENOMEM;
+	nuc_led_shared->version = NUCLED_IOC_VERSION;
+
 	// Create nuc_led ACPI proc entry
 	acpi_entry = proc_create("nuc_led", nuc_led_perms, acpi_root_dir,
 				 &proc_acpi_operations);
 
 	if (acpi_entry == NULL) {
 		pr_warn("Intel NUC LED control driver could not create proc entry\n");
+		free_page((unsigned long)nuc_led_shared);
 		return -ENOMEM;
 	}
 
 	proc_set_user(acpi_entry, uid, gid);
 
-	pr_info("Intel NUC LED control driver loaded\n");
+	// Create /dev/nuc_led for binary access
+	nuc_led_miscdev.mode = nuc_led_perms;
+	ret = misc_register(&nuc_led_miscdev);
+	if (ret) {
+		pr_warn("Intel NUC LED control driver could not create /dev/nuc_led\n");
+		remove_proc_entry("nuc_led", acpi_root_dir);
+		free_page((unsigned long)nuc_led_shared);
+		return ret;
+	}
+
+	// Restore the state after resuming
+	ret = register_pm_notifier(&nuc_led_pm_nb);
+	if (ret) {
+		pr_warn("Intel NUC LED control driver could not register a PM notifier\n");
+		misc_deregister(&nuc_led_miscdev);
+		remove_proc_entry("nuc_led", acpi_root_dir);
+		free_page((unsigned long)nuc_led_shared);
+		return ret;
+	}
+	nuc_led_uevents_on = true;
+
+	nuc_led_create_debugfs();
+
+	schedule_work(&nuc_led_probe_work);
+
+	pr_info("Intel NUC LED control driver loaded (%s backend)\n",
+		nuc_led_backend->name);
 
 	return 0;
 }
 
 static void __exit unload_nuc_led(void)
 {
+	// Readers may be waiting for the probe, let it finish
+	flush_work(&nuc_led_probe_work);
+	unregister_pm_notifier(&nuc_led_pm_nb);
+	flush_work(&nuc_led_pm_work);
+	flush_work(&nuc_led_register_work);
+	nuc_led_unregister_sysfs();
+	nuc_led_unregister_classdevs();
+
+	// No more uevents once the device is gone
+	nuc_led_state_lock();
+	nuc_led_uevents_on = false;
+	nuc_led_state_unlock();
+	cancel_delayed_work_sync(&nuc_led_uevent_work);
+	misc_deregister(&nuc_led_miscdev);
 	remove_proc_entry("nuc_led", acpi_root_dir);
+	debugfs_remove_recursive(nuc_led_debugfs);
+
+	// Let queued writes reach firmware
+	nuc_led_free_animations();
+	nuc_led_queue_flush();
+
+	nuc_led_state_lock();
+	nuc_led_clear_leds();
+	nuc_led_state_unlock();
+	flush_work(&nuc_led_publish_work);
+
+	free_page((unsigned long)nuc_led_shared);
+
 	pr_info("Intel NUC LED control driver unloaded\n");
 }
 
@@ -42,10 +42,122 @@ module_param(nuc_led_perms, uint, S_IRUGO | S_IWUSR | S_IWGRP);
 module_param(nuc_led_uid, uint, 0);
 module_param(nuc_led_gid, uint, 0);
 
-MODULE_PARM_DESC(nuc_led_perms, "permissions on /proc/acpi/nuc_led");
+MODULE_PARM_DESC(nuc_led_perms, "permissions on /proc/acpi/nuc_led and /dev/nuc_led");
 MODULE_PARM_DESC(nuc_led_uid, "default owner of /proc/acpi/nuc_led");
 MODULE_PARM_DESC(nuc_led_gid, "default owning group of /proc/acpi/nuc_led");
 
+static unsigned int anim_max_hz __read_mostly = 20;
+
+module_param(anim_max_hz, uint, S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(anim_max_hz, "maximum animation frame rate per second (default 20)");
+
+static bool async_writes __read_mostly;
+
+module_param(async_writes, bool, S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(async_writes, "queue writes and return before they reach firmware (default 0)");
+
+static unsigned int max_hz __read_mostly;
+static unsigned int max_burst __read_mostly = 8;
+
+module_param(max_hz, uint, S_IRUGO | S_IWUSR);
+module_param(max_burst, uint, S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(max_hz, "maximum firmware writes per second and LED, 0 for no limit (default 0)");
+MODULE_PARM_DESC(max_burst, "firmware writes per LED allowed back to back under max_hz (default 8)");
+
+static char *backend = "wmi";
+static unsigned int sim_latency_us;
+static unsigned int sim_fail_every;
+static int sim_fail_code;
+
+module_param(backend, charp, S_IRUGO);
+module_param(sim_latency_us, uint, S_IRUGO | S_IWUSR);
+module_param(sim_fail_every, uint, S_IRUGO | S_IWUSR);
+module_param(sim_fail_code, int, S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(backend, "firmware backend: wmi, or sim for a simulated NUC8i7HVK (default wmi)");
+MODULE_PARM_DESC(sim_latency_us, "sim backend: time each call takes in microseconds (default 0)");
+MODULE_PARM_DESC(sim_fail_every, "sim backend: fail every Nth call, 0 for never (default 0)");
+MODULE_PARM_DESC(sim_fail_code, "sim backend: return code of failed calls, 0 to fail the evaluation itself (default 0)");
+
+/* Formats of /proc/acpi/nuc_led, indexed by output_format */
+enum nuc_led_output_format {
+	NUCLED_OUTPUT_TEXT,
+	NUCLED_OUTPUT_JSON,
+	NUCLED_OUTPUT_KV,
+};
+
+static const char *const nuc_led_output_formats[] = { "text", "json", "kv" };
+static unsigned int output_format __read_mostly = NUCLED_OUTPUT_TEXT;
+
+static int nuc_led_output_format_set(const char *val,
+				     const struct kernel_param *kp)
+{
+	int format = sysfs_match_string(nuc_led_output_formats, val);
+
+	if (format < 0)
+		return format;
+	WRITE_ONCE(*(unsigned int *)kp->arg, format);
+	return 0;
+}
+
+static int nuc_led_output_format_get(char *buf, const struct kernel_param *kp)
+{
+	unsigned int format = READ_ONCE(*(unsigned int *)kp->arg);
+
+	return sprintf(buf, "%s\n", nuc_led_output_formats[format]);
+}
+
+static const struct kernel_param_ops nuc_led_output_format_ops = {
+	.set = nuc_led_output_format_set,
+	.get = nuc_led_output_format_get,
+};
+
+module_param_cb(output_format, &nuc_led_output_format_ops, &output_format,
+		S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(output_format, "format of /proc/acpi/nuc_led: text, json or kv (default text)");
+
+/* Color pipeline of set_color, set_led, set_hsv, animations and LED class devices */
+#define NUCLED_GAMMA_MIN 10
+#define NUCLED_GAMMA_MAX 500
+
+static unsigned int color_gamma __read_mostly = 100;
+static unsigned int color_threshold __read_mostly;
+
+static int nuc_led_color_gamma_set(const char *val,
+				   const struct kernel_param *kp)
+{
+	unsigned int gamma;
+	int ret = kstrtouint(val, 0, &gamma);
+
+	if (ret)
+		return ret;
+	if (gamma < NUCLED_GAMMA_MIN || gamma > NUCLED_GAMMA_MAX)
+		return -EINVAL;
+	WRITE_ONCE(*(unsigned int *)kp->arg, gamma);
+	return 0;
+}
+
+static int nuc_led_color_gamma_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(*(unsigned int *)kp->arg));
+}
+
+static const struct kernel_param_ops nuc_led_color_gamma_ops = {
+	.set = nuc_led_color_gamma_set,
+	.get = nuc_led_color_gamma_get,
+};
+
+module_param_cb(color_gamma, &nuc_led_color_gamma_ops, &color_gamma,
+		S_IRUGO | S_IWUSR);
+module_param(color_threshold, uint, S_IRUGO | S_IWUSR);
+
+MODULE_PARM_DESC(color_gamma, "gamma of brightness and RGB values times 100, 10-500, 100 for none (default 100)");
+MODULE_PARM_DESC(color_threshold, "smallest visible color change, in 0-255 steps, 0 to send every change (default 0)");
+
 /* Intel NUC WMI GUID */
 #define NUCLED_WMI_MGMT_GUID "8C5DA44C-CDC3-46B3-8619-4E26D34390B7"
 MODULE_ALIAS("wmi:" NUCLED_WMI_MGMT_GUID);
@@ -71,15 +183,20 @@ MODULE_ALIAS("wmi:" NUCLED_WMI_MGMT_GUID);
 /* proc interaction */
 #define NUCLED_PROC_SET_INDICATOR			0x01
 #define NUCLED_PROC_SETINDICATOROPTIONVALUE	0x02
+#define NUCLED_PROC_REFRESH					0x03
+#define NUCLED_PROC_SET_COLOR				0x04
+#define NUCLED_PROC_SET_BLINK				0x05
+#define NUCLED_PROC_SET_LED					0x06
+#define NUCLED_PROC_PRESET_ADD				0x07
+#define NUCLED_PROC_PRESET_CLEAR			0x08
+#define NUCLED_PROC_APPLY_PRESET			0x09
+#define NUCLED_PROC_SET_HSV					0x0A
 
-/* Indicator options / usage types */
-#define NUCLED_USAGE_TYPE_POWER_STATE	0x00
-#define NUCLED_USAGE_TYPE_HDD_ACTIVITY	0x01
-#define NUCLED_USAGE_TYPE_ETHERNET		0x02
-#define NUCLED_USAGE_TYPE_WIFI			0x03
-#define NUCLED_USAGE_TYPE_SOFTWARE		0x04
-#define NUCLED_USAGE_TYPE_POWER_LIMIT	0x05
-#define NUCLED_USAGE_TYPE_DISABLE		0x06
+/* Largest batch of commands accepted by a single proc write */
+#define NUCLED_PROC_MAX_INPUT	(4 * PAGE_SIZE)
+
+/* Indicators whose values don't survive sleep, restored after resume */
+#define NUCLED_PM_VOLATILE_INDICATORS	BIT(NUCLED_USAGE_TYPE_SOFTWARE)
 
 /* Return codes */
 #define NUCLED_WMI_RETURN_SUCCESS		0x00
@@ -131,65 +248,68 @@ typedef union {
 	};
 } INDICATOR_OPTIONS;
 
-typedef struct {
-	u8 red;
-	u8 green;
-	u8 blue;
-} LED_RGB;
-
-typedef struct {
-	u8 brightness;
-	u8 blink_behavior;
-	u8 blink_freq;
-	LED_RGB color;
-} BLINK_LED;
-
-typedef struct {
-	u8 brightness;
-	LED_RGB color;
-} FLASH_LED;
-
-struct power_state_indicator {
-	BLINK_LED s0;
-	BLINK_LED s3;
-	BLINK_LED ready_mode;
-	BLINK_LED s5;
-} __packed;
-
-struct hdd_activity_indicator {
-	FLASH_LED led;
-	u8 behavior;
-} __packed;
-
-struct ethernet_indicator {
-	u8 type;
-	FLASH_LED led;
-} __packed;
-
-struct wifi_indicator {
-	FLASH_LED led;
-} __packed;
-
-struct software_indicator {
-	BLINK_LED led;
-} __packed;
-
-struct power_limit_indicator {
-	u8 indication_scheme;
-	FLASH_LED led;
-} __packed;
-
 extern struct proc_dir_entry *acpi_root_dir;
 
+/* Values of any indicator, item ids are byte offsets into raw */
+typedef union {
+	u8 raw[sizeof(struct power_state_indicator)]; /* the largest */
+	struct power_state_indicator power_state;
+	struct hdd_activity_indicator hdd_activity;
+	struct ethernet_indicator ethernet;
+	struct wifi_indicator wifi;
+	struct software_indicator software;
+	struct power_limit_indicator power_limit;
+} INDICATOR_VALUES;
+
 typedef struct {
 	const char *name;
 	u8 led_type;
 	LED_COLOR_TYPES led_color_type;
 	u8 usage_type;
 	u8 indicator_option;
-	u8 *indicator;
+	bool indicator_valid; /* indicator holds the current indicator's values */
+	INDICATOR_VALUES indicator;
+	/* Values of the other indicators, read the first time they are needed */
+	u8 others_valid; /* bit per indicator whose values others holds */
+	INDICATOR_VALUES others[NUCLED_USAGE_TYPE_DISABLE];
 } LED_INFO;
 
+/* Action specific arguments following the LED and indicator ids */
+#define NUCLED_CMD_MAX_ARGS 7
+
+/* Presets, stored in fixed tables like the LED state */
+#define NUCLED_MAX_PRESETS 16
+#define NUCLED_PRESET_MAX_OPS 64
+#define NUCLED_PRESET_NAME_LEN 16 /* including the terminating NUL */
+
+/* One line of a proc write batch */
+struct nuc_led_cmd {
+	int line;
+	u8 action;
+	u8 led_id;
+	u8 indicator_id;
+	u8 num_args;
+	u8 args[NUCLED_CMD_MAX_ARGS];
+	char name[NUCLED_PRESET_NAME_LEN]; /* preset commands only */
+	u16 hue; /* set_hsv only, 0-359, args[0] is unused */
+	bool exact; /* not subject to color_threshold */
+};
+
+/* One set_indicator or set_indicator_value op of a preset */
+struct nuc_led_preset_op {
+	u8 action; /* NUCLED_PROC_SET_INDICATOR or SETINDICATOROPTIONVALUE */
+	u8 led_id;
+	u8 indicator_id;
+	u8 item_id;
+	u8 value;
+};
+
+struct nuc_led_preset {
+	char name[NUCLED_PRESET_NAME_LEN]; /* empty if the slot is free */
+	u8 num_ops;
+	struct nuc_led_preset_op ops[NUCLED_PRESET_MAX_OPS];
+};
+
 struct acpi_args {
 	u8 arg1;
 	u8 arg2;
@@ -198,11 +318,21 @@ struct acpi_args {
 	u8 arg5; /* required on Phantom Canyon */
 } __packed;
 
-#define BUFFER_SIZE 4096
-static char result_buffer[BUFFER_SIZE];
-static char *get_buffer_end(void) {
-	return result_buffer + strlen(result_buffer);
-}
+/* Every reply starts with a NUCLED_WMI_RETURN_* code */
+#define NUCLED_WMI_REPLY_SIZE 4
+
+/* Where WMI method calls go: the firmware, or a simulation of it */
+struct nuc_led_backend {
+	const char *name;
+	/*
+	 * Evaluate method_id and fill reply with its NUCLED_WMI_REPLY_SIZE
+	 * bytes. Returns -EIO if the method could not be evaluated at all.
+	 */
+	int (*evaluate)(u32 method_id, const struct acpi_args *args,
+			u8 *reply);
+	/* Optional, called before suspending once the state is saved */
+	void (*suspend)(void);
+};
 
 static const char *const led_names[] = {
 	"Power",
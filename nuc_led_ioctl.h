@@ -0,0 +1,149 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Binary interface of /dev/nuc_led, shared by the driver and userspace.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef NUC_LED_IOCTL_H
+#define NUC_LED_IOCTL_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Bumped whenever a structure below changes */
+#define NUCLED_IOC_VERSION 2
+
+/* At most 8 LEDs per the LED_TYPES bitfield */
+#define NUCLED_MAX_LEDS 8
+
+/* Largest packed indicator struct (struct power_state_indicator) */
+#define NUCLED_MAX_INDICATOR_SIZE 24
+
+/* Most ops accepted by one NUCLED_IOC_APPLY */
+#define NUCLED_IOC_MAX_OPS 256
+
+/* One LED, mirrors LED_INFO */
+struct nuc_led_ioc_led {
+	__u8 led_type;
+	__u8 color_type; /* LED_COLOR_TYPES flags */
+	__u8 usage_type; /* supported indicators, INDICATOR_OPTIONS flags */
+	__u8 indicator_option; /* current indicator */
+	__u8 indicator_size; /* valid bytes in indicator */
+	__u8 reserved[3];
+	__u8 indicator[NUCLED_MAX_INDICATOR_SIZE]; /* packed indicator struct */
+};
+
+/* NUCLED_IOC_GET_LEDS */
+struct nuc_led_ioc_table {
+	__u32 version; /* out: NUCLED_IOC_VERSION */
+	__u32 num_leds;
+	struct nuc_led_ioc_led leds[NUCLED_MAX_LEDS];
+};
+
+/* NUCLED_IOC_GET_INDICATOR */
+struct nuc_led_ioc_indicator {
+	__u8 led_type; /* in */
+	__u8 indicator_option; /* in */
+	__u8 size; /* out: valid bytes in values */
+	__u8 reserved;
+	__u8 values[NUCLED_MAX_INDICATOR_SIZE]; /* out: packed indicator struct */
+};
+
+/* nuc_led_ioc_op actions */
+#define NUCLED_OP_SET_INDICATOR 0x01 /* select indicator_option for led_type */
+#define NUCLED_OP_SET_VALUE 0x02 /* set item of indicator_option to value */
+
+struct nuc_led_ioc_op {
+	__u8 action;
+	__u8 led_type;
+	__u8 indicator_option;
+	__u8 item;
+	__u8 value;
+	__u8 reserved[3];
+	__s32 result; /* out: 0 or a negative errno */
+};
+
+/* NUCLED_IOC_APPLY */
+struct nuc_led_ioc_ops {
+	__u32 count;
+	__u32 flags; /* must be 0 */
+	__u64 ops; /* pointer to struct nuc_led_ioc_op[count] */
+};
+
+/* Most keyframes in one animation */
+#define NUCLED_ANIM_MAX_KEYFRAMES 64
+
+/* Easing from a keyframe towards the next one */
+#define NUCLED_EASE_LINEAR 0x00
+#define NUCLED_EASE_IN 0x01 /* quadratic, slow start */
+#define NUCLED_EASE_OUT 0x02 /* quadratic, slow end */
+#define NUCLED_EASE_IN_OUT 0x03
+#define NUCLED_EASE_STEP 0x04 /* hold until the next keyframe */
+
+struct nuc_led_keyframe {
+	__u32 time_ms; /* since the animation started, non-decreasing */
+	__u8 brightness; /* 0-100 */
+	__u8 red;
+	__u8 green;
+	__u8 blue;
+	__u8 easing; /* NUCLED_EASE_* */
+	__u8 reserved[3];
+};
+
+/* nuc_led_ioc_animation flags */
+#define NUCLED_ANIM_LOOP 0x01 /* restart after the last keyframe */
+
+/*
+ * NUCLED_IOC_ANIM_LOAD. The animation is played back through the LED's
+ * Software indicator. Loading replaces (and stops) any previous one.
+ */
+struct nuc_led_ioc_animation {
+	__u8 led_type;
+	__u8 reserved[3];
+	__u32 flags; /* NUCLED_ANIM_* */
+	__u32 num_keyframes;
+	__u32 reserved2;
+	__u64 keyframes; /* pointer to struct nuc_led_keyframe[num_keyframes] */
+};
+
+/*
+ * Layout of the read-only page that can be mmap()ed from /dev/nuc_led
+ * (offset 0, one page). The driver updates it whenever the LED state
+ * changes. sequence is odd while an update is in progress; readers take
+ * a consistent snapshot without any syscall with:
+ *
+ *	do {
+ *		seq = __atomic_load_n(&state->sequence, __ATOMIC_ACQUIRE);
+ *		memcpy(&copy, state, sizeof(copy));
+ *		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *	} while ((seq & 1) ||
+ *		 seq != __atomic_load_n(&state->sequence, __ATOMIC_RELAXED));
+ */
+struct nuc_led_shared_state {
+	__u32 sequence;
+	__u32 version; /* NUCLED_IOC_VERSION */
+	__u32 num_leds;
+	__u32 reserved;
+	__u64 generation; /* state generation, 0 if none (since version 2) */
+	struct nuc_led_ioc_led leds[NUCLED_MAX_LEDS];
+};
+
+#define NUCLED_IOC_MAGIC 'N'
+
+#define NUCLED_IOC_GET_VERSION _IOR(NUCLED_IOC_MAGIC, 0xa0, __u32)
+#define NUCLED_IOC_GET_LEDS _IOR(NUCLED_IOC_MAGIC, 0xa1, struct nuc_led_ioc_table)
+#define NUCLED_IOC_GET_INDICATOR                                               \
+	_IOWR(NUCLED_IOC_MAGIC, 0xa2, struct nuc_led_ioc_indicator)
+#define NUCLED_IOC_APPLY _IOWR(NUCLED_IOC_MAGIC, 0xa3, struct nuc_led_ioc_ops)
+#define NUCLED_IOC_ANIM_LOAD                                                   \
+	_IOW(NUCLED_IOC_MAGIC, 0xa4, struct nuc_led_ioc_animation)
+/* Start or stop the animations of a bitmask of LEDs (1 << led_type) */
+#define NUCLED_IOC_ANIM_START _IOW(NUCLED_IOC_MAGIC, 0xa5, __u32)
+#define NUCLED_IOC_ANIM_STOP _IOW(NUCLED_IOC_MAGIC, 0xa6, __u32)
+
+#endif
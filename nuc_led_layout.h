@@ -0,0 +1,231 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Names and item layout of the LEDs and indicators, shared by the driver
+ * and userspace. Builds as C and C++.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef NUC_LED_LAYOUT_H
+#define NUC_LED_LAYOUT_H
+
+#include <linux/types.h>
+#ifndef __KERNEL__
+#include <stddef.h>
+#endif
+
+#define NUCLED_ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+/* Indexed by LED type, names of the LED devices and sysfs directories */
+static const char *const led_short_names[] = {
+	"power", "hdd", "skull", "eyes", "front1", "front2", "front3",
+};
+
+/* Indicator options / usage types */
+#define NUCLED_USAGE_TYPE_POWER_STATE	0x00
+#define NUCLED_USAGE_TYPE_HDD_ACTIVITY	0x01
+#define NUCLED_USAGE_TYPE_ETHERNET		0x02
+#define NUCLED_USAGE_TYPE_WIFI			0x03
+#define NUCLED_USAGE_TYPE_SOFTWARE		0x04
+#define NUCLED_USAGE_TYPE_POWER_LIMIT	0x05
+#define NUCLED_USAGE_TYPE_DISABLE		0x06
+
+typedef struct {
+	__u8 red;
+	__u8 green;
+	__u8 blue;
+} LED_RGB;
+
+typedef struct {
+	__u8 brightness;
+	__u8 blink_behavior;
+	__u8 blink_freq;
+	LED_RGB color;
+} BLINK_LED;
+
+typedef struct {
+	__u8 brightness;
+	LED_RGB color;
+} FLASH_LED;
+
+struct power_state_indicator {
+	BLINK_LED s0;
+	BLINK_LED s3;
+	BLINK_LED ready_mode;
+	BLINK_LED s5;
+} __attribute__((packed));
+
+struct hdd_activity_indicator {
+	FLASH_LED led;
+	__u8 behavior;
+} __attribute__((packed));
+
+struct ethernet_indicator {
+	__u8 type;
+	FLASH_LED led;
+} __attribute__((packed));
+
+struct wifi_indicator {
+	FLASH_LED led;
+} __attribute__((packed));
+
+struct software_indicator {
+	BLINK_LED led;
+} __attribute__((packed));
+
+struct power_limit_indicator {
+	__u8 indication_scheme;
+	FLASH_LED led;
+} __attribute__((packed));
+
+/*
+ * Item ids of one BLINK_LED or FLASH_LED within an indicator. Item ids
+ * are byte offsets into the packed indicator structs above.
+ */
+#define NUCLED_NO_ITEM 0xff
+
+struct nuc_led_color_items {
+	__u8 brightness;
+	__u8 blink_behavior; /* NUCLED_NO_ITEM on a FLASH_LED */
+	__u8 blink_freq; /* NUCLED_NO_ITEM on a FLASH_LED */
+	__u8 red;
+	__u8 green;
+	__u8 blue;
+};
+
+#define NUCLED_BLINK_ITEMS(type, member)                                       \
+	{                                                                      \
+		.brightness = offsetof(type, member.brightness),               \
+		.blink_behavior = offsetof(type, member.blink_behavior),       \
+		.blink_freq = offsetof(type, member.blink_freq),               \
+		.red = offsetof(type, member.color.red),                       \
+		.green = offsetof(type, member.color.green),                   \
+		.blue = offsetof(type, member.color.blue),                     \
+	}
+
+#define NUCLED_FLASH_ITEMS(type, member)                                       \
+	{                                                                      \
+		.brightness = offsetof(type, member.brightness),               \
+		.blink_behavior = NUCLED_NO_ITEM,                              \
+		.blink_freq = NUCLED_NO_ITEM,                                  \
+		.red = offsetof(type, member.color.red),                       \
+		.green = offsetof(type, member.color.green),                   \
+		.blue = offsetof(type, member.color.blue),                     \
+	}
+
+static const struct nuc_led_color_items power_state_items[] = {
+	NUCLED_BLINK_ITEMS(struct power_state_indicator, s0),
+	NUCLED_BLINK_ITEMS(struct power_state_indicator, s3),
+	NUCLED_BLINK_ITEMS(struct power_state_indicator, ready_mode),
+	NUCLED_BLINK_ITEMS(struct power_state_indicator, s5),
+};
+static const struct nuc_led_color_items hdd_activity_items[] = {
+	NUCLED_FLASH_ITEMS(struct hdd_activity_indicator, led),
+};
+static const struct nuc_led_color_items ethernet_items[] = {
+	NUCLED_FLASH_ITEMS(struct ethernet_indicator, led),
+};
+static const struct nuc_led_color_items wifi_items[] = {
+	NUCLED_FLASH_ITEMS(struct wifi_indicator, led),
+};
+static const struct nuc_led_color_items software_items[] = {
+	NUCLED_BLINK_ITEMS(struct software_indicator, led),
+};
+static const struct nuc_led_color_items power_limit_items[] = {
+	NUCLED_FLASH_ITEMS(struct power_limit_indicator, led),
+};
+
+/* Name of every item of an indicator, as used in sysfs */
+struct nuc_led_field {
+	const char *name;
+	__u8 item_id;
+};
+
+#define NUCLED_FIELD(type, member, field_name)                                 \
+	{ .name = field_name, .item_id = offsetof(type, member) }
+
+#define NUCLED_BLINK_FIELDS(type, member, prefix)                              \
+	NUCLED_FIELD(type, member.brightness, prefix "brightness"),            \
+	NUCLED_FIELD(type, member.blink_behavior, prefix "blink_behavior"),    \
+	NUCLED_FIELD(type, member.blink_freq, prefix "blink_freq"),            \
+	NUCLED_FIELD(type, member.color.red, prefix "red"),                    \
+	NUCLED_FIELD(type, member.color.green, prefix "green"),                \
+	NUCLED_FIELD(type, member.color.blue, prefix "blue")
+
+#define NUCLED_FLASH_FIELDS(type, member, prefix)                              \
+	NUCLED_FIELD(type, member.brightness, prefix "brightness"),            \
+	NUCLED_FIELD(type, member.color.red, prefix "red"),                    \
+	NUCLED_FIELD(type, member.color.green, prefix "green"),                \
+	NUCLED_FIELD(type, member.color.blue, prefix "blue")
+
+static const struct nuc_led_field power_state_fields[] = {
+	NUCLED_BLINK_FIELDS(struct power_state_indicator, s0, "s0_"),
+	NUCLED_BLINK_FIELDS(struct power_state_indicator, s3, "s3_"),
+	NUCLED_BLINK_FIELDS(struct power_state_indicator, ready_mode,
+			    "ready_mode_"),
+	NUCLED_BLINK_FIELDS(struct power_state_indicator, s5, "s5_"),
+};
+static const struct nuc_led_field hdd_activity_fields[] = {
+	NUCLED_FLASH_FIELDS(struct hdd_activity_indicator, led, ""),
+	NUCLED_FIELD(struct hdd_activity_indicator, behavior, "behavior"),
+};
+static const struct nuc_led_field ethernet_fields[] = {
+	NUCLED_FIELD(struct ethernet_indicator, type, "type"),
+	NUCLED_FLASH_FIELDS(struct ethernet_indicator, led, ""),
+};
+static const struct nuc_led_field wifi_fields[] = {
+	NUCLED_FLASH_FIELDS(struct wifi_indicator, led, ""),
+};
+static const struct nuc_led_field software_fields[] = {
+	NUCLED_BLINK_FIELDS(struct software_indicator, led, ""),
+};
+static const struct nuc_led_field power_limit_fields[] = {
+	NUCLED_FIELD(struct power_limit_indicator, indication_scheme,
+		     "indication_scheme"),
+	NUCLED_FLASH_FIELDS(struct power_limit_indicator, led, ""),
+};
+
+/* Field layout of each indicator, indexed by usage type */
+struct nuc_led_indicator_layout {
+	const char *name;
+	__u8 size;
+	__u8 num_colors;
+	__u8 num_fields;
+	const struct nuc_led_color_items *colors;
+	const struct nuc_led_field *fields; /* every item, in item id order */
+};
+
+#define NUCLED_LAYOUT(layout_name, type, items, item_fields)                   \
+	{                                                                      \
+		.name = layout_name, .size = sizeof(type),                     \
+		.num_colors = NUCLED_ARRAY_SIZE(items),                        \
+		.num_fields = NUCLED_ARRAY_SIZE(item_fields),                  \
+		.colors = items, .fields = item_fields,                        \
+	}
+
+static const struct nuc_led_indicator_layout nuc_led_indicator_layouts[] = {
+	[NUCLED_USAGE_TYPE_POWER_STATE] =
+		NUCLED_LAYOUT("power_state", struct power_state_indicator,
+			      power_state_items, power_state_fields),
+	[NUCLED_USAGE_TYPE_HDD_ACTIVITY] =
+		NUCLED_LAYOUT("hdd_activity", struct hdd_activity_indicator,
+			      hdd_activity_items, hdd_activity_fields),
+	[NUCLED_USAGE_TYPE_ETHERNET] =
+		NUCLED_LAYOUT("ethernet", struct ethernet_indicator,
+			      ethernet_items, ethernet_fields),
+	[NUCLED_USAGE_TYPE_WIFI] =
+		NUCLED_LAYOUT("wifi", struct wifi_indicator, wifi_items,
+			      wifi_fields),
+	[NUCLED_USAGE_TYPE_SOFTWARE] =
+		NUCLED_LAYOUT("software", struct software_indicator,
+			      software_items, software_fields),
+	[NUCLED_USAGE_TYPE_POWER_LIMIT] =
+		NUCLED_LAYOUT("power_limit", struct power_limit_indicator,
+			      power_limit_items, power_limit_fields),
+};
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Simulated firmware backend (backend=sim). It implements the LED
+ * control methods of the WMI specification (specs/INTEL_WMI_LED_0.64.pdf)
+ * on an in-memory NUC8i7HVK, so the driver can be exercised without the
+ * hardware, in the kernel or built into the userspace tools under sim/.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef NUC_LED_SIM_H
+#define NUC_LED_SIM_H
+
+#define NUCLED_SIM_NUM_INDICATORS ARRAY_SIZE(nuc_led_indicator_layouts)
+
+struct nuc_led_sim_led {
+	u8 color_type; /* LED_COLOR_TYPES flags */
+	u8 usage_type; /* INDICATOR_OPTIONS flags */
+	u8 indicator_option;
+	u8 values[NUCLED_SIM_NUM_INDICATORS][NUCLED_MAX_INDICATOR_SIZE];
+};
+
+/* The LEDs of a NUC8i7HVK, all indicators off. Protected by nuc_led_lock. */
+static struct nuc_led_sim_led nuc_led_sim_leds[] = {
+	{ 0x01, 0x71, NUCLED_USAGE_TYPE_POWER_STATE }, /* Power, blue/amber */
+	{ 0x02, 0x53, NUCLED_USAGE_TYPE_HDD_ACTIVITY }, /* HDD, blue/white */
+	{ 0x04, 0x7f, NUCLED_USAGE_TYPE_POWER_STATE }, /* Skull, RGB */
+	{ 0x04, 0x7f, NUCLED_USAGE_TYPE_SOFTWARE }, /* Eyes, RGB */
+	{ 0x04, 0x7f, NUCLED_USAGE_TYPE_ETHERNET }, /* Front 1, RGB */
+	{ 0x04, 0x7f, NUCLED_USAGE_TYPE_WIFI }, /* Front 2, RGB */
+	{ 0x04, 0x7f, NUCLED_USAGE_TYPE_HDD_ACTIVITY }, /* Front 3, RGB */
+};
+
+static unsigned int nuc_led_sim_calls;
+
+/* Reject values outside the ranges of the specification */
+static u8 nuc_led_sim_check_value(u8 indicator_option, u8 item_id, u8 value)
+{
+	const struct nuc_led_indicator_layout *layout =
+		&nuc_led_indicator_layouts[indicator_option];
+	const struct nuc_led_color_items *items;
+	int c;
+
+	for (c = 0; c < layout->num_colors; c++) {
+		items = &layout->colors[c];
+		if (item_id == items->brightness && value > 100)
+			return NUCLED_WMI_RETURN_BADPARAM;
+		if (item_id == items->blink_behavior &&
+		    value >= ARRAY_SIZE(led_blink_behaviors))
+			return NUCLED_WMI_RETURN_BADPARAM;
+		if (item_id == items->blink_freq && (value < 1 || value > 10))
+			return NUCLED_WMI_RETURN_BADPARAM;
+	}
+	return NUCLED_WMI_RETURN_SUCCESS;
+}
+
+static u8 nuc_led_sim_query_led(const struct acpi_args *args, u8 *reply)
+{
+	struct nuc_led_sim_led *led;
+	int i;
+
+	if (args->arg1 == 0) {
+		for (i = 0; i < ARRAY_SIZE(nuc_led_sim_leds); i++)
+			reply[1] |= 1 << i;
+		return NUCLED_WMI_RETURN_SUCCESS;
+	}
+
+	if (args->arg2 >= ARRAY_SIZE(nuc_led_sim_leds))
+		return NUCLED_WMI_RETURN_BADPARAM;
+	led = &nuc_led_sim_leds[args->arg2];
+
+	switch (args->arg1) {
+	case NUCLED_WMI_METHODARG_QUERYLEDCOLORTYPE:
+		reply[1] = led->color_type;
+		return NUCLED_WMI_RETURN_SUCCESS;
+	case NUCLED_WMI_METHODARG_QUERYINDICATORSUPPORT:
+		reply[1] = led->usage_type;
+		return NUCLED_WMI_RETURN_SUCCESS;
+	}
+	return NUCLED_WMI_RETURN_BADPARAM;
+}
+
+static u8 nuc_led_sim_get_status(const struct acpi_args *args, u8 *reply)
+{
+	struct nuc_led_sim_led *led;
+
+	if (args->arg2 >= ARRAY_SIZE(nuc_led_sim_leds))
+		return NUCLED_WMI_RETURN_BADPARAM;
+	led = &nuc_led_sim_leds[args->arg2];
+
+	switch (args->arg1) {
+	case NUCLED_WMI_METHODARG_GETCURRENTINDICATOR:
+		reply[1] = led->indicator_option;
+		return NUCLED_WMI_RETURN_SUCCESS;
+	case NUCLED_WMI_METHODARG_GETINDICATOROPTIONVALUE:
+		if (args->arg3 >= NUCLED_SIM_NUM_INDICATORS ||
+		    !(led->usage_type & (1 << args->arg3)))
+			return NUCLED_WMI_RETURN_NOSUPPORT;
+		if (args->arg4 >= nuc_led_indicator_layouts[args->arg3].size)
+			return NUCLED_WMI_RETURN_BADPARAM;
+		reply[1] = led->values[args->arg3][args->arg4];
+		return NUCLED_WMI_RETURN_SUCCESS;
+	}
+	return NUCLED_WMI_RETURN_BADPARAM;
+}
+
+static u8 nuc_led_sim_set_indicator(const struct acpi_args *args)
+{
+	struct nuc_led_sim_led *led;
+
+	if (args->arg1 >= ARRAY_SIZE(nuc_led_sim_leds))
+		return NUCLED_WMI_RETURN_BADPARAM;
+	led = &nuc_led_sim_leds[args->arg1];
+
+	if (args->arg2 > NUCLED_USAGE_TYPE_DISABLE ||
+	    !(led->usage_type & (1 << args->arg2)))
+		return NUCLED_WMI_RETURN_NOSUPPORT;
+
+	led->indicator_option = args->arg2;
+	return NUCLED_WMI_RETURN_SUCCESS;
+}
+
+static u8 nuc_led_sim_set_value(const struct acpi_args *args)
+{
+	struct nuc_led_sim_led *led;
+	u8 ret;
+
+	if (args->arg1 >= ARRAY_SIZE(nuc_led_sim_leds))
+		return NUCLED_WMI_RETURN_BADPARAM;
+	led = &nuc_led_sim_leds[args->arg1];
+
+	if (args->arg2 >= NUCLED_SIM_NUM_INDICATORS ||
+	    !(led->usage_type & (1 << args->arg2)))
+		return NUCLED_WMI_RETURN_NOSUPPORT;
+	if (args->arg3 >= nuc_led_indicator_layouts[args->arg2].size)
+		return NUCLED_WMI_RETURN_BADPARAM;
+
+	ret = nuc_led_sim_check_value(args->arg2, args->arg3, args->arg4);
+	if (ret == NUCLED_WMI_RETURN_SUCCESS)
+		led->values[args->arg2][args->arg3] = args->arg4;
+	return ret;
+}
+
+/* Going to sleep loses the values of volatile indicators */
+static void nuc_led_sim_suspend(void)
+{
+	int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(nuc_led_sim_leds); i++) {
+		for (j = 0; j < NUCLED_SIM_NUM_INDICATORS; j++) {
+			if (NUCLED_PM_VOLATILE_INDICATORS & BIT(j))
+				memset(nuc_led_sim_leds[i].values[j], 0,
+				       NUCLED_MAX_INDICATOR_SIZE);
+		}
+	}
+}
+
+static int nuc_led_sim_evaluate(u32 method_id, const struct acpi_args *args,
+				u8 *reply)
+{
+	unsigned int latency = READ_ONCE(sim_latency_us);
+	unsigned int fail_every = READ_ONCE(sim_fail_every);
+
+	if (latency < 10)
+		udelay(latency);
+	else
+		usleep_range(latency, latency + latency / 8);
+
+	memset(reply, 0, NUCLED_WMI_REPLY_SIZE);
+
+	// Error injection
+	if (fail_every && ++nuc_led_sim_calls % fail_every == 0) {
+		if (!READ_ONCE(sim_fail_code))
+			return -EIO;
+		reply[0] = READ_ONCE(sim_fail_code);
+		return 0;
+	}
+
+	switch (method_id) {
+	case NUCLED_WMI_METHODID_QUERYLED:
+		reply[0] = nuc_led_sim_query_led(args, reply);
+		break;
+	case NUCLED_WMI_METHODID_NEWGETLEDSTATUS:
+		reply[0] = nuc_led_sim_get_status(args, reply);
+		break;
+	case NUCLED_WMI_METHODID_SETINDICATOROPTIONLEDTYPE:
+		reply[0] = nuc_led_sim_set_indicator(args);
+		break;
+	case NUCLED_WMI_METHODID_SETVALUEINDICATOROPTIONLEDTYPE:
+		reply[0] = nuc_led_sim_set_value(args);
+		break;
+	default:
+		reply[0] = NUCLED_WMI_RETURN_UNDEFINED;
+		break;
+	}
+	return 0;
+}
+
+static const struct nuc_led_backend nuc_led_sim_backend = {
+	.name = "sim",
+	.evaluate = nuc_led_sim_evaluate,
+	.suspend = nuc_led_sim_suspend,
+};
+
+#endif
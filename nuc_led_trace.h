@@ -0,0 +1,148 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Tracepoints, available under events/nuc_led in tracefs.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nuc_led
+
+#if !defined(NUC_LED_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define NUC_LED_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* A proc line or ioctl op, ret is 0 or a negative errno */
+DECLARE_EVENT_CLASS(nuc_led_cmd,
+	TP_PROTO(int line, u8 action, u8 led_id, u8 indicator_id, u8 num_args,
+		 int ret),
+	TP_ARGS(line, action, led_id, indicator_id, num_args, ret),
+
+	TP_STRUCT__entry(
+		__field(int, line)
+		__field(u8, action)
+		__field(u8, led_id)
+		__field(u8, indicator_id)
+		__field(u8, num_args)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__entry->line = line;
+		__entry->action = action;
+		__entry->led_id = led_id;
+		__entry->indicator_id = indicator_id;
+		__entry->num_args = num_args;
+		__entry->ret = ret;
+	),
+
+	TP_printk("line=%d action=%u led=%u indicator=%u args=%u ret=%d",
+		  __entry->line, __entry->action, __entry->led_id,
+		  __entry->indicator_id, __entry->num_args, __entry->ret)
+);
+
+DEFINE_EVENT(nuc_led_cmd, nuc_led_cmd_parse,
+	TP_PROTO(int line, u8 action, u8 led_id, u8 indicator_id, u8 num_args,
+		 int ret),
+	TP_ARGS(line, action, led_id, indicator_id, num_args, ret)
+);
+
+DEFINE_EVENT(nuc_led_cmd, nuc_led_cmd_exec,
+	TP_PROTO(int line, u8 action, u8 led_id, u8 indicator_id, u8 num_args,
+		 int ret),
+	TP_ARGS(line, action, led_id, indicator_id, num_args, ret)
+);
+
+/* args points to the 5 argument bytes of struct acpi_args */
+TRACE_EVENT(nuc_led_wmi_entry,
+	TP_PROTO(u32 method_id, const u8 *args),
+	TP_ARGS(method_id, args),
+
+	TP_STRUCT__entry(
+		__field(u32, method_id)
+		__array(u8, args, 5)
+	),
+
+	TP_fast_assign(
+		__entry->method_id = method_id;
+		memcpy(__entry->args, args, 5);
+	),
+
+	TP_printk("method=%u args=%s", __entry->method_id,
+		  __print_hex(__entry->args, 5))
+);
+
+/*
+ * err is 0 or a negative errno if the method could not be evaluated,
+ * code the firmware return code, or -1 if there is none
+ */
+TRACE_EVENT(nuc_led_wmi_exit,
+	TP_PROTO(u32 method_id, int err, int code, s64 duration_ns),
+	TP_ARGS(method_id, err, code, duration_ns),
+
+	TP_STRUCT__entry(
+		__field(u32, method_id)
+		__field(int, err)
+		__field(int, code)
+		__field(s64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__entry->method_id = method_id;
+		__entry->err = err;
+		__entry->code = code;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("method=%u err=%d code=%d duration_ns=%lld",
+		  __entry->method_id, __entry->err, __entry->code,
+		  __entry->duration_ns)
+);
+
+/*
+ * Lookups in the LED cache. led_id and item_id are 0xff when the lookup
+ * is about all LEDs or a whole indicator.
+ */
+DECLARE_EVENT_CLASS(nuc_led_cache,
+	TP_PROTO(u8 led_id, u8 indicator_id, u8 item_id),
+	TP_ARGS(led_id, indicator_id, item_id),
+
+	TP_STRUCT__entry(
+		__field(u8, led_id)
+		__field(u8, indicator_id)
+		__field(u8, item_id)
+	),
+
+	TP_fast_assign(
+		__entry->led_id = led_id;
+		__entry->indicator_id = indicator_id;
+		__entry->item_id = item_id;
+	),
+
+	TP_printk("led=%u indicator=%u item=%u", __entry->led_id,
+		  __entry->indicator_id, __entry->item_id)
+);
+
+DEFINE_EVENT(nuc_led_cache, nuc_led_cache_hit,
+	TP_PROTO(u8 led_id, u8 indicator_id, u8 item_id),
+	TP_ARGS(led_id, indicator_id, item_id)
+);
+
+DEFINE_EVENT(nuc_led_cache, nuc_led_cache_miss,
+	TP_PROTO(u8 led_id, u8 indicator_id, u8 item_id),
+	TP_ARGS(led_id, indicator_id, item_id)
+);
+
+#endif
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nuc_led_trace
+#include <trace/define_trace.h>
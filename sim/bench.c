@@ -0,0 +1,415 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * nuc_led_bench: measures the driver interface against the simulated
+ * firmware and prints a JSON report, meant to be diffed between releases.
+ *
+ *  read        read of the full /proc/acpi/nuc_led dump
+ *  write       a single set_color command
+ *  batch       one write of batch_size set_color commands
+ *  concurrent  readers and writers in parallel for a fixed time,
+ *              reported as concurrent_read and concurrent_write
+ *
+ * Latencies are in microseconds, wmi_calls_per_op counts the firmware
+ * calls (wmi debugfs statistics) the operations caused.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../nuc_led.c"
+
+#define BENCH_RGB_LED_FIRST 2
+#define BENCH_RGB_LED_LAST 6
+
+static struct {
+	unsigned int iterations;
+	unsigned int batch_size;
+	unsigned int readers;
+	unsigned int writers;
+	unsigned int seconds;
+} bench_opts = {
+	.iterations = 1000,
+	.batch_size = 16,
+	.readers = 4,
+	.writers = 2,
+	.seconds = 2,
+};
+
+/* Latencies of one kind of operation, in nanoseconds */
+struct bench_samples {
+	u64 *ns;
+	size_t count;
+	size_t size;
+	unsigned int errors;
+};
+
+static u64 bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void bench_add(struct bench_samples *s, u64 ns, int err)
+{
+	if (err)
+		s->errors++;
+	if (s->count == s->size) {
+		s->size = s->size ? s->size * 2 : 1024;
+		s->ns = realloc(s->ns, s->size * sizeof(*s->ns));
+		if (!s->ns)
+			abort();
+	}
+	s->ns[s->count++] = ns;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Nearest rank percentile, per mille */
+static double bench_percentile(const struct bench_samples *s,
+			       unsigned int permille)
+{
+	size_t rank;
+
+	if (!s->count)
+		return 0;
+	rank = (s->count * permille + 999) / 1000;
+	return s->ns[rank ? rank - 1 : 0] / 1000.0;
+}
+
+static u64 bench_wmi_calls(void)
+{
+	struct nuc_led_wmi_stats sum;
+	u64 calls = 0;
+	u32 method_id;
+
+	for (method_id = 0; method_id < NUCLED_WMI_NUM_METHODS; method_id++) {
+		nuc_led_wmi_sum(method_id, &sum);
+		calls += sum.calls;
+	}
+	return calls;
+}
+
+/* Read the whole proc file, like cat does */
+static int bench_read(char *buf, size_t size)
+{
+	struct file *file = sim_open("proc/nuc_led", FMODE_READ);
+	loff_t pos = 0;
+	ssize_t len;
+
+	if (!file)
+		return -ENOENT;
+	while ((len = file->f_op->read(file, buf, size, &pos)) > 0)
+		;
+	sim_close(file);
+	return len;
+}
+
+static int bench_write(const char *buf, size_t len)
+{
+	struct file *file = sim_open("proc/nuc_led", FMODE_WRITE);
+	loff_t pos = 0;
+	ssize_t ret;
+
+	if (!file)
+		return -ENOENT;
+	ret = file->f_op->write(file, buf, len, &pos);
+	sim_close(file);
+	return ret < 0 ? ret : 0;
+}
+
+/*
+ * A set_color command that differs from the previous one for the same
+ * LED, so it is never skipped as already set
+ */
+static int bench_format_cmd(char *buf, size_t size, unsigned int n)
+{
+	unsigned int leds = BENCH_RGB_LED_LAST - BENCH_RGB_LED_FIRST + 1;
+	unsigned int v = n / leds;
+
+	return snprintf(buf, size, "set_color,%u,%u,%u,%u,%u,%u\n",
+			BENCH_RGB_LED_FIRST + n % leds,
+			NUCLED_USAGE_TYPE_SOFTWARE, v % 100 + 1, v % 256,
+			(v * 7) % 256, (v * 13) % 256);
+}
+
+static void bench_report(const char *name, struct bench_samples *s,
+			 u64 wmi_calls, u64 elapsed_ns, unsigned int ops,
+			 bool last)
+{
+	qsort(s->ns, s->count, sizeof(*s->ns), bench_cmp);
+
+	printf("    \"%s\": {\n", name);
+	printf("      \"ops\": %u,\n", ops);
+	printf("      \"errors\": %u,\n", s->errors);
+	printf("      \"ops_per_sec\": %.1f,\n",
+	       elapsed_ns ? ops * (double)NSEC_PER_SEC / elapsed_ns : 0);
+	printf("      \"p50_us\": %.1f,\n", bench_percentile(s, 500));
+	printf("      \"p99_us\": %.1f,\n", bench_percentile(s, 990));
+	printf("      \"p999_us\": %.1f,\n", bench_percentile(s, 999));
+	printf("      \"max_us\": %.1f,\n",
+	       s->count ? s->ns[s->count - 1] / 1000.0 : 0);
+	printf("      \"wmi_calls_per_op\": %.2f\n",
+	       ops ? (double)wmi_calls / ops : 0);
+	printf("    }%s\n", last ? "" : ",");
+}
+
+static void bench_run_read(void)
+{
+	struct bench_samples s = {};
+	char buf[4096];
+	u64 start, t, calls;
+	unsigned int i;
+	int err;
+
+	calls = bench_wmi_calls();
+	start = bench_now();
+	for (i = 0; i < bench_opts.iterations; i++) {
+		t = bench_now();
+		err = bench_read(buf, sizeof(buf));
+		bench_add(&s, bench_now() - t, err);
+	}
+	bench_report("read", &s, bench_wmi_calls() - calls,
+		     bench_now() - start, i, false);
+	free(s.ns);
+}
+
+static void bench_run_write(void)
+{
+	struct bench_samples s = {};
+	char cmd[64];
+	u64 start, t, calls;
+	unsigned int i;
+	int len, err;
+
+	calls = bench_wmi_calls();
+	start = bench_now();
+	for (i = 0; i < bench_opts.iterations; i++) {
+		len = bench_format_cmd(cmd, sizeof(cmd), i);
+		t = bench_now();
+		err = bench_write(cmd, len);
+		bench_add(&s, bench_now() - t, err);
+	}
+	nuc_led_queue_flush();
+	bench_report("write", &s, bench_wmi_calls() - calls,
+		     bench_now() - start, i, false);
+	free(s.ns);
+}
+
+/* Batch latencies are per write, throughput and calls per command */
+static void bench_run_batch(void)
+{
+	size_t size = bench_opts.batch_size * 64;
+	struct bench_samples s = {};
+	unsigned int i, j, n = 0;
+	u64 start, t, calls;
+	char *buf = malloc(size);
+	size_t len;
+	int err;
+
+	if (!buf)
+		abort();
+
+	calls = bench_wmi_calls();
+	start = bench_now();
+	for (i = 0; i < bench_opts.iterations / bench_opts.batch_size + 1;
+	     i++) {
+		for (len = 0, j = 0; j < bench_opts.batch_size; j++)
+			len += bench_format_cmd(buf + len, size - len, n++);
+		t = bench_now();
+		err = bench_write(buf, len);
+		bench_add(&s, bench_now() - t, err);
+	}
+	nuc_led_queue_flush();
+	bench_report("batch", &s, bench_wmi_calls() - calls,
+		     bench_now() - start, n, false);
+	free(s.ns);
+	free(buf);
+}
+
+struct bench_thread {
+	pthread_t thread;
+	bool writer;
+	unsigned int id;
+	struct bench_samples samples;
+};
+
+static volatile bool bench_stop;
+
+static void *bench_thread_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned int n = bt->id;
+	char buf[4096];
+	int len, err;
+	u64 t;
+
+	while (!READ_ONCE(bench_stop)) {
+		if (bt->writer) {
+			len = bench_format_cmd(buf, sizeof(buf), n);
+			n += bench_opts.writers;
+			t = bench_now();
+			err = bench_write(buf, len);
+		} else {
+			t = bench_now();
+			err = bench_read(buf, sizeof(buf));
+		}
+		bench_add(&bt->samples, bench_now() - t, err);
+	}
+	return NULL;
+}
+
+static void bench_merge(struct bench_samples *dst,
+			const struct bench_samples *src)
+{
+	size_t i;
+
+	for (i = 0; i < src->count; i++)
+		bench_add(dst, src->ns[i], 0);
+	dst->errors += src->errors;
+}
+
+/*
+ * Readers and writers in parallel. Firmware calls are only attributed to
+ * the writers, readers are served from the published snapshot.
+ */
+static void bench_run_concurrent(void)
+{
+	unsigned int nthreads = bench_opts.readers + bench_opts.writers;
+	struct bench_thread *threads = calloc(nthreads, sizeof(*threads));
+	struct bench_samples reads = {}, writes = {};
+	u64 start, elapsed, calls;
+	unsigned int i;
+
+	if (!threads)
+		abort();
+
+	bench_stop = false;
+	calls = bench_wmi_calls();
+	start = bench_now();
+	for (i = 0; i < nthreads; i++) {
+		threads[i].writer = i < bench_opts.writers;
+		threads[i].id = i;
+		pthread_create(&threads[i].thread, NULL, bench_thread_fn,
+			       &threads[i]);
+	}
+	usleep(bench_opts.seconds * USEC_PER_SEC);
+	WRITE_ONCE(bench_stop, true);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		bench_merge(threads[i].writer ? &writes : &reads,
+			    &threads[i].samples);
+		free(threads[i].samples.ns);
+	}
+	nuc_led_queue_flush();
+	elapsed = bench_now() - start;
+	calls = bench_wmi_calls() - calls;
+
+	bench_report("concurrent_read", &reads, 0, elapsed, reads.count,
+		     false);
+	bench_report("concurrent_write", &writes, calls, elapsed,
+		     writes.count, true);
+
+	free(reads.ns);
+	free(writes.ns);
+	free(threads);
+}
+
+static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: nuc_led_bench [-ah] [-l latency_us] [-n iterations] [-b batch_size]\n"
+		"                     [-R readers] [-W writers] [-t seconds] [-r max_hz]\n"
+		"\n"
+		"  -a  queue writes (async_writes=1)\n"
+		"  -l  time each firmware call takes (default 0)\n"
+		"  -n  operations of the read, write and batch runs (default 1000)\n"
+		"  -b  commands per batch write (default 16)\n"
+		"  -R  reader threads of the concurrent run (default 4)\n"
+		"  -W  writer threads of the concurrent run (default 2)\n"
+		"  -t  duration of the concurrent run (default 2)\n"
+		"  -r  rate limit per LED (max_hz)\n");
+	exit(status);
+}
+
+int main(int argc, char **argv)
+{
+	char buf[4096];
+	int opt;
+
+	backend = "sim";
+
+	while ((opt = getopt(argc, argv, "al:n:b:R:W:t:r:h")) != -1) {
+		switch (opt) {
+		case 'a':
+			async_writes = true;
+			break;
+		case 'l':
+			sim_latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			bench_opts.iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bench_opts.batch_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			bench_opts.readers = strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			bench_opts.writers = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			bench_opts.seconds = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			max_hz = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(opt == 'h' ? 0 : 2);
+		}
+	}
+	if (optind != argc || !bench_opts.iterations || !bench_opts.batch_size)
+		usage(2);
+
+	if (init_nuc_led())
+		return 1;
+
+	// The first read probes the LEDs, measure the steady state
+	bench_read(buf, sizeof(buf));
+
+	printf("{\n");
+	printf("  \"config\": {\n");
+	printf("    \"sim_latency_us\": %u,\n", sim_latency_us);
+	printf("    \"async_writes\": %s,\n", async_writes ? "true" : "false");
+	printf("    \"max_hz\": %u,\n", max_hz);
+	printf("    \"iterations\": %u,\n", bench_opts.iterations);
+	printf("    \"batch_size\": %u,\n", bench_opts.batch_size);
+	printf("    \"readers\": %u,\n", bench_opts.readers);
+	printf("    \"writers\": %u,\n", bench_opts.writers);
+	printf("    \"seconds\": %u\n", bench_opts.seconds);
+	printf("  },\n");
+	printf("  \"results\": {\n");
+	bench_run_read();
+	bench_run_write();
+	bench_run_batch();
+	bench_run_concurrent();
+	printf("  }\n");
+	printf("}\n");
+
+	unload_nuc_led();
+	return 0;
+}
@@ -0,0 +1,110 @@
+#!/bin/sh
+#
+# Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+#
+# Scripted checks run by "make check": each one runs sim/nuc_led_sim and
+# compares the state, the statistics or the number of WMI calls it reports
+# with what the feature promises.
+#
+#  This program is free software; you can redistribute it and/or modify
+#  it under the terms of the GNU General Public License as published by
+#  the Free Software Foundation; either version 2 of the License, or
+#  (at your option) any later version.
+
+SIM=${SIM:-./sim/nuc_led_sim}
+SET_VALUE=SETVALUEINDICATOROPTIONLEDTYPE
+failed=0
+
+# sim_stat name [option...] [command...]: a statistic or WMI call count
+sim_stat() {
+	name=$1
+	shift
+	value=$(timeout 10 "$SIM" -q -s "$@" </dev/null 2>/dev/null |
+		sed -n "s/^$name: \(calls \)\{0,1\}\([0-9][0-9]*\).*/\2/p")
+	echo "${value:-0}"
+}
+
+# sim_value key [option...] [command...]: a value of the key=value dump
+sim_value() {
+	key=$1
+	shift
+	timeout 10 "$SIM" -o kv "$@" </dev/null 2>/dev/null | sed -n "s/^$key=//p"
+}
+
+# expect description actual expected
+expect() {
+	if [ "$2" = "$3" ]; then
+		echo "ok: $1"
+	else
+		echo "FAIL: $1: got '$2', expected '$3'"
+		failed=1
+	fi
+}
+
+# Values in sequence, one set_indicator_value line each for eyes brightness
+brightness_lines() {
+	for v in "$@"; do
+		echo "set_indicator_value,3,4,0,$v"
+	done
+}
+
+# Cache: a composite command that changes nothing costs no firmware call
+color='set_color,3,4,100,255,30,100'
+expect "set_color sends 4 items" "$(sim_stat $SET_VALUE "$color")" 4
+expect "repeated set_color is skipped" \
+	"$(sim_stat $SET_VALUE "$color
+$color")" 4
+
+# sysfs: an indicator that isn't the current one is read from firmware once
+field=sys/kernel/nuc_led/eyes/power_state/s0_red
+expect "repeated sysfs read is cached" \
+	"$(sim_stat NEWGETLEDSTATUS -R $field -R $field)" \
+	"$(sim_stat NEWGETLEDSTATUS -R $field)"
+
+# Batches: one bad line and nothing is applied, every line has a result
+batch="$(brightness_lines 10)
+bogus
+$(brightness_lines 20)"
+expect "bad batch makes no WMI call" "$(sim_stat $SET_VALUE "$batch")" 0
+expect "bad batch leaves the state" \
+	"$(sim_value eyes.software.brightness "$batch")" 0
+expect "bad batch reports each line" \
+	"$(timeout 10 "$SIM" -q -b "$batch" </dev/null 2>/dev/null |
+		grep -c '^Line [0-9]*: error')" 3
+expect "good batch is applied" \
+	"$(sim_value eyes.software.brightness "$(brightness_lines 10 20)")" 20
+
+# Write queue: writes to the same item coalesce, the last one wins
+queued=$(brightness_lines 10 20 30)
+expect "queued writes coalesce" "$(sim_stat queue_coalesced -a "$queued")" 2
+expect "queued writes make one WMI call" \
+	"$(sim_stat $SET_VALUE -a "$queued")" 1
+expect "last queued write wins" \
+	"$(sim_value eyes.software.brightness -a "$queued")" 30
+
+# Rate limiter: max_burst (8) writes go through, later ones are deferred
+limited=$(brightness_lines 1 2 3 4 5 6 7 8 9 10 11 12)
+expect "writes over max_hz are deferred" \
+	"$(sim_stat rate_deferred -r 1 "$limited")" 4
+expect "deferred writes coalesce into one WMI call" \
+	"$(sim_stat $SET_VALUE -r 1 "$limited")" 9
+expect "last deferred write wins" \
+	"$(sim_value eyes.software.brightness -r 1 "$limited")" 12
+
+# Resume: what firmware forgot is written back, nothing else
+expect "resume restores one item" \
+	"$(sim_stat pm_restore_writes -S "$(brightness_lines 10)")" 1
+expect "resume restores the value" \
+	"$(sim_value eyes.software.brightness -S "$(brightness_lines 10)")" 10
+
+# Color threshold: a change below color_threshold is not sent
+hsv='set_hsv,3,4,0,100,100'
+close='set_hsv,3,4,2,100,100'
+expect "close color is suppressed" \
+	"$(sim_stat color_suppressed -t 10 "$hsv" "$close")" 1
+expect "close color makes no WMI call" \
+	"$(sim_stat $SET_VALUE -t 10 "$hsv" "$close")" 2
+expect "without a threshold it is sent" \
+	"$(sim_stat $SET_VALUE -t 0 "$hsv" "$close")" 3
+
+exit $failed
@@ -0,0 +1,19 @@
+/* Tracepoints compile to empty inline functions in userspace */
+#ifndef SIM_LINUX_TRACEPOINT_H
+#define SIM_LINUX_TRACEPOINT_H
+
+#include "../../kernel.h"
+
+#define TP_PROTO(...) __VA_ARGS__
+#define TP_ARGS(...) __VA_ARGS__
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print)                 \
+	static inline void trace_##name(proto)                                 \
+	{                                                                      \
+	}
+#define DECLARE_EVENT_CLASS(name, proto, args, tstruct, assign, print)
+#define DEFINE_EVENT(template, name, proto, args)                              \
+	static inline void trace_##name(proto)                                 \
+	{                                                                      \
+	}
+
+#endif
@@ -0,0 +1 @@
+#include_next <linux/types.h>
@@ -0,0 +1 @@
+/* Tracepoints compile to nothing in userspace */
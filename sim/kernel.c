@@ -0,0 +1,1032 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Userspace implementation of the kernel API declared in kernel.h.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <sched.h>
+#include <time.h>
+
+#include "kernel.h"
+
+int sim_verbose;
+
+struct proc_dir_entry *acpi_root_dir;
+
+void *memdup_user(const void *src, size_t len)
+{
+	void *p = malloc(len ? len : 1);
+
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	return p;
+}
+
+void *memdup_user_nul(const void *src, size_t len)
+{
+	char *p = malloc(len + 1);
+
+	if (!p)
+		return ERR_PTR(-ENOMEM);
+	memcpy(p, src, len);
+	p[len] = '\0';
+	return p;
+}
+
+/* Like the kernel, a single trailing newline is accepted */
+static int sim_kstrtoul(const char *s, unsigned int base, unsigned long max,
+			unsigned long *res)
+{
+	unsigned long val;
+	char *end;
+
+	if (!*s || *s == '-' || *s == '+' || *s == ' ')
+		return -EINVAL;
+
+	errno = 0;
+	val = strtoul(s, &end, base);
+	if (end == s || errno)
+		return -EINVAL;
+	if (*end == '\n')
+		end++;
+	if (*end)
+		return -EINVAL;
+	if (val > max)
+		return -ERANGE;
+
+	*res = val;
+	return 0;
+}
+
+int kstrtou8(const char *s, unsigned int base, u8 *res)
+{
+	unsigned long val;
+	int ret = sim_kstrtoul(s, base, 0xff, &val);
+
+	if (!ret)
+		*res = val;
+	return ret;
+}
+
+int kstrtou16(const char *s, unsigned int base, u16 *res)
+{
+	unsigned long val;
+	int ret = sim_kstrtoul(s, base, 0xffff, &val);
+
+	if (!ret)
+		*res = val;
+	return ret;
+}
+
+int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+	unsigned long val;
+	int ret = sim_kstrtoul(s, base, UINT_MAX, &val);
+
+	if (!ret)
+		*res = val;
+	return ret;
+}
+
+char *strim(char *s)
+{
+	size_t len;
+
+	while (*s == ' ' || *s == '\t' || *s == '\n' || *s == '\r')
+		s++;
+
+	len = strlen(s);
+	while (len && (s[len - 1] == ' ' || s[len - 1] == '\t' ||
+		       s[len - 1] == '\n' || s[len - 1] == '\r'))
+		s[--len] = '\0';
+
+	return s;
+}
+
+ssize_t strscpy(char *dest, const char *src, size_t count)
+{
+	size_t len = strnlen(src, count);
+
+	if (!count)
+		return -E2BIG;
+	if (len == count) {
+		memcpy(dest, src, count - 1);
+		dest[count - 1] = '\0';
+		return -E2BIG;
+	}
+	memcpy(dest, src, len + 1);
+	return len;
+}
+
+/* Time */
+ktime_t ktime_get(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ktime_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static void sim_sleep_ns(u64 ns)
+{
+	struct timespec ts = { ns / NSEC_PER_SEC, ns % NSEC_PER_SEC };
+
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+void udelay(unsigned long usecs)
+{
+	ktime_t end = ktime_get() + (ktime_t)usecs * NSEC_PER_USEC;
+
+	while (ktime_get() < end)
+		;
+}
+
+void usleep_range(unsigned long min, unsigned long max)
+{
+	sim_sleep_ns((u64)min * NSEC_PER_USEC);
+}
+
+void msleep(unsigned int msecs)
+{
+	sim_sleep_ns((u64)msecs * NSEC_PER_MSEC);
+}
+
+unsigned long msleep_interruptible(unsigned int msecs)
+{
+	msleep(msecs);
+	return 0;
+}
+
+void cond_resched(void)
+{
+	sched_yield();
+}
+
+/*
+ * RCU. Writers are preferred so that a stream of readers can't hold off
+ * a grace period, which makes nested read sections deadlock.
+ */
+pthread_rwlock_t sim_rcu_lock = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+/* Grace periods completed so far */
+static unsigned long sim_rcu_completed;
+
+/* kfree_rcu() callbacks waiting for their grace period */
+static pthread_mutex_t sim_rcu_free_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_head *sim_rcu_free_list;
+
+static void sim_rcu_free_done(void)
+{
+	unsigned long completed = get_state_synchronize_rcu();
+	struct rcu_head **p, *head;
+
+	pthread_mutex_lock(&sim_rcu_free_lock);
+	p = &sim_rcu_free_list;
+	while ((head = *p)) {
+		if (head->state == completed) {
+			p = &head->next;
+			continue;
+		}
+		*p = head->next;
+		free(head->ptr);
+	}
+	pthread_mutex_unlock(&sim_rcu_free_lock);
+}
+
+void synchronize_rcu(void)
+{
+	pthread_rwlock_wrlock(&sim_rcu_lock);
+	sim_rcu_completed++;
+	pthread_rwlock_unlock(&sim_rcu_lock);
+	sim_rcu_free_done();
+}
+
+unsigned long get_state_synchronize_rcu(void)
+{
+	return __atomic_load_n(&sim_rcu_completed, __ATOMIC_ACQUIRE);
+}
+
+void cond_synchronize_rcu(unsigned long oldstate)
+{
+	if (get_state_synchronize_rcu() == oldstate)
+		synchronize_rcu();
+}
+
+/* A grace period ends whenever there are no readers at that moment */
+bool poll_state_synchronize_rcu(unsigned long oldstate)
+{
+	if (get_state_synchronize_rcu() != oldstate)
+		return true;
+	if (pthread_rwlock_trywrlock(&sim_rcu_lock))
+		return false;
+	sim_rcu_completed++;
+	pthread_rwlock_unlock(&sim_rcu_lock);
+	sim_rcu_free_done();
+	return true;
+}
+
+void sim_kfree_rcu(void *ptr, struct rcu_head *head)
+{
+	head->state = get_state_synchronize_rcu();
+	head->ptr = ptr;
+	pthread_mutex_lock(&sim_rcu_free_lock);
+	head->next = sim_rcu_free_list;
+	sim_rcu_free_list = head;
+	pthread_mutex_unlock(&sim_rcu_free_lock);
+}
+
+/*
+ * Work queues. A single worker runs every work item once it is due, so
+ * an item never runs concurrently with itself.
+ */
+#define SIM_MAX_WORKS 16
+
+static pthread_mutex_t sim_wq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_wq_cond = PTHREAD_COND_INITIALIZER;
+static struct work_struct *sim_works[SIM_MAX_WORKS];
+static int sim_num_works;
+static pthread_once_t sim_wq_once = PTHREAD_ONCE_INIT;
+
+static void *sim_worker(void *unused)
+{
+	struct work_struct *work;
+	struct timespec ts;
+	ktime_t now, due;
+	int i;
+
+	pthread_mutex_lock(&sim_wq_lock);
+	for (;;) {
+		work = NULL;
+		for (i = 0; i < sim_num_works; i++) {
+			if (sim_works[i]->pending &&
+			    (!work || sim_works[i]->due < work->due))
+				work = sim_works[i];
+		}
+
+		if (!work) {
+			pthread_cond_wait(&sim_wq_cond, &sim_wq_lock);
+			continue;
+		}
+
+		now = ktime_get();
+		if (work->due > now) {
+			// Sleep until due, or until the queue changes
+			clock_gettime(CLOCK_REALTIME, &ts);
+			due = (ktime_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec +
+			      work->due - now;
+			ts.tv_sec = due / NSEC_PER_SEC;
+			ts.tv_nsec = due % NSEC_PER_SEC;
+			pthread_cond_timedwait(&sim_wq_cond, &sim_wq_lock, &ts);
+			continue;
+		}
+
+		work->pending = false;
+		work->running = true;
+		pthread_mutex_unlock(&sim_wq_lock);
+
+		work->func(work);
+
+		pthread_mutex_lock(&sim_wq_lock);
+		work->running = false;
+		work->completed++;
+		pthread_cond_broadcast(&sim_wq_cond);
+	}
+
+	return NULL;
+}
+
+static void sim_wq_start(void)
+{
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, sim_worker, NULL);
+	pthread_detach(thread);
+}
+
+/* Called with sim_wq_lock held */
+static void sim_wq_add(struct work_struct *work, unsigned long delay)
+{
+	int i;
+
+	for (i = 0; i < sim_num_works && sim_works[i] != work; i++)
+		;
+	if (i == sim_num_works) {
+		if (sim_num_works == SIM_MAX_WORKS)
+			abort();
+		sim_works[sim_num_works++] = work;
+	}
+
+	work->pending = true;
+	work->due = ktime_get() + (ktime_t)delay * NSEC_PER_MSEC;
+	pthread_cond_broadcast(&sim_wq_cond);
+}
+
+static bool sim_queue_work(struct work_struct *work, unsigned long delay)
+{
+	bool queued = false;
+
+	pthread_once(&sim_wq_once, sim_wq_start);
+
+	pthread_mutex_lock(&sim_wq_lock);
+	if (!work->pending) {
+		sim_wq_add(work, delay);
+		queued = true;
+	}
+	pthread_mutex_unlock(&sim_wq_lock);
+
+	return queued;
+}
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work)
+{
+	return sim_queue_work(work, 0);
+}
+
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+			unsigned long delay)
+{
+	return sim_queue_work(&dwork->work, delay);
+}
+
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+		      unsigned long delay)
+{
+	bool pending;
+
+	pthread_once(&sim_wq_once, sim_wq_start);
+
+	pthread_mutex_lock(&sim_wq_lock);
+	pending = dwork->work.pending;
+	sim_wq_add(&dwork->work, delay);
+	pthread_mutex_unlock(&sim_wq_lock);
+
+	return pending;
+}
+
+bool cancel_delayed_work_sync(struct delayed_work *dwork)
+{
+	bool pending;
+
+	pthread_mutex_lock(&sim_wq_lock);
+	pending = dwork->work.pending;
+	dwork->work.pending = false;
+	while (dwork->work.running)
+		pthread_cond_wait(&sim_wq_cond, &sim_wq_lock);
+	pthread_mutex_unlock(&sim_wq_lock);
+
+	return pending;
+}
+
+/* Run a pending work now and wait for that run, not for later requeues */
+bool flush_work(struct work_struct *work)
+{
+	unsigned long target;
+
+	pthread_mutex_lock(&sim_wq_lock);
+	if (!work->pending && !work->running) {
+		pthread_mutex_unlock(&sim_wq_lock);
+		return false;
+	}
+
+	target = work->completed + work->running + work->pending;
+	if (work->pending) {
+		work->due = 0;
+		pthread_cond_broadcast(&sim_wq_cond);
+	}
+	while (work->completed < target)
+		pthread_cond_wait(&sim_wq_cond, &sim_wq_lock);
+	pthread_mutex_unlock(&sim_wq_lock);
+
+	return true;
+}
+
+bool flush_delayed_work(struct delayed_work *dwork)
+{
+	return flush_work(&dwork->work);
+}
+
+/* Completions */
+static pthread_mutex_t sim_completion_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_completion_cond = PTHREAD_COND_INITIALIZER;
+
+void complete_all(struct completion *x)
+{
+	pthread_mutex_lock(&sim_completion_lock);
+	x->done = true;
+	pthread_cond_broadcast(&sim_completion_cond);
+	pthread_mutex_unlock(&sim_completion_lock);
+}
+
+void reinit_completion(struct completion *x)
+{
+	pthread_mutex_lock(&sim_completion_lock);
+	x->done = false;
+	pthread_mutex_unlock(&sim_completion_lock);
+}
+
+void wait_for_completion(struct completion *x)
+{
+	pthread_mutex_lock(&sim_completion_lock);
+	while (!x->done)
+		pthread_cond_wait(&sim_completion_cond, &sim_completion_lock);
+	pthread_mutex_unlock(&sim_completion_lock);
+}
+
+/* Wait queues */
+static pthread_mutex_t sim_wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_wait_cond = PTHREAD_COND_INITIALIZER;
+
+void wake_up_interruptible(wait_queue_head_t *wq)
+{
+	pthread_mutex_lock(&sim_wait_lock);
+	wq->wakeups++;
+	pthread_cond_broadcast(&sim_wait_cond);
+	pthread_mutex_unlock(&sim_wait_lock);
+}
+
+unsigned long sim_wait_start(wait_queue_head_t *wq)
+{
+	unsigned long wakeups;
+
+	pthread_mutex_lock(&sim_wait_lock);
+	wakeups = wq->wakeups;
+	pthread_mutex_unlock(&sim_wait_lock);
+	return wakeups;
+}
+
+/* Sleep until wq is woken up after sim_wait_start() returned wakeups */
+void sim_wait(wait_queue_head_t *wq, unsigned long wakeups)
+{
+	pthread_mutex_lock(&sim_wait_lock);
+	while (wq->wakeups == wakeups)
+		pthread_cond_wait(&sim_wait_cond, &sim_wait_lock);
+	pthread_mutex_unlock(&sim_wait_lock);
+}
+
+/* Power management */
+static struct notifier_block *sim_pm_notifiers;
+
+int register_pm_notifier(struct notifier_block *nb)
+{
+	nb->next = sim_pm_notifiers;
+	sim_pm_notifiers = nb;
+	return 0;
+}
+
+int unregister_pm_notifier(struct notifier_block *nb)
+{
+	struct notifier_block **p;
+
+	for (p = &sim_pm_notifiers; *p; p = &(*p)->next) {
+		if (*p == nb) {
+			*p = nb->next;
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+void sim_pm_notify(unsigned long action)
+{
+	struct notifier_block *nb;
+
+	for (nb = sim_pm_notifiers; nb; nb = nb->next)
+		nb->notifier_call(nb, action, NULL);
+}
+
+/* Threads */
+struct task_struct {
+	pthread_t thread;
+	int (*fn)(void *data);
+	void *data;
+	bool should_stop;
+};
+
+static __thread struct task_struct *sim_current;
+
+static void *sim_kthread(void *arg)
+{
+	struct task_struct *task = arg;
+
+	sim_current = task;
+	task->fn(task->data);
+	return NULL;
+}
+
+struct task_struct *sim_kthread_run(int (*fn)(void *data), void *data)
+{
+	struct task_struct *task = calloc(1, sizeof(*task));
+
+	if (!task)
+		return ERR_PTR(-ENOMEM);
+
+	task->fn = fn;
+	task->data = data;
+	if (pthread_create(&task->thread, NULL, sim_kthread, task)) {
+		free(task);
+		return ERR_PTR(-EAGAIN);
+	}
+	return task;
+}
+
+bool kthread_should_stop(void)
+{
+	return __atomic_load_n(&sim_current->should_stop, __ATOMIC_ACQUIRE);
+}
+
+int kthread_stop(struct task_struct *task)
+{
+	__atomic_store_n(&task->should_stop, true, __ATOMIC_RELEASE);
+	pthread_join(task->thread, NULL);
+	free(task);
+	return 0;
+}
+
+/* seq_file */
+static void seq_vprintf(struct seq_file *m, const char *fmt, va_list args)
+{
+	va_list copy;
+	size_t size;
+	int len;
+
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, fmt, copy);
+	va_end(copy);
+	if (len < 0)
+		return;
+
+	if (m->count + len + 1 > m->size) {
+		size = max(m->size * 2, m->count + len + 1);
+		m->buf = realloc(m->buf, size);
+		if (!m->buf)
+			abort();
+		m->size = size;
+	}
+
+	vsnprintf(m->buf + m->count, len + 1, fmt, args);
+	m->count += len;
+}
+
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	seq_vprintf(m, fmt, args);
+	va_end(args);
+}
+
+void seq_puts(struct seq_file *m, const char *s)
+{
+	seq_printf(m, "%s", s);
+}
+
+void seq_putc(struct seq_file *m, char c)
+{
+	seq_printf(m, "%c", c);
+}
+
+int seq_open(struct file *file, const struct seq_operations *op)
+{
+	struct seq_file *m = calloc(1, sizeof(*m));
+
+	if (!m)
+		return -ENOMEM;
+	m->op = op;
+	file->private_data = m;
+	return 0;
+}
+
+static int seq_render(struct seq_file *m)
+{
+	loff_t pos = 0;
+	void *v;
+	int ret = 0;
+
+	if (m->single_show)
+		return m->single_show(m, NULL);
+
+	v = m->op->start(m, &pos);
+	while (v && !IS_ERR(v)) {
+		ret = m->op->show(m, v);
+		if (ret)
+			break;
+		v = m->op->next(m, v, &pos);
+	}
+	m->op->stop(m, v);
+
+	return IS_ERR(v) ? PTR_ERR(v) : ret;
+}
+
+ssize_t seq_read(struct file *file, char *buf, size_t len, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	int ret;
+
+	if (!m->rendered) {
+		mutex_lock(&m->lock);
+		ret = seq_render(m);
+		mutex_unlock(&m->lock);
+		if (ret)
+			return ret;
+		m->rendered = true;
+	}
+
+	if (*ppos >= m->count)
+		return 0;
+
+	len = min(len, m->count - (size_t)*ppos);
+	memcpy(buf, m->buf + *ppos, len);
+	*ppos += len;
+	return len;
+}
+
+loff_t seq_lseek(struct file *file, loff_t offset, int whence)
+{
+	return -ESPIPE;
+}
+
+int seq_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	free(m->buf);
+	free(m);
+	return 0;
+}
+
+void *__seq_open_private(struct file *file, const struct seq_operations *op,
+			 int psize)
+{
+	void *private = calloc(1, psize);
+	struct seq_file *m;
+
+	if (!private || seq_open(file, op)) {
+		free(private);
+		return NULL;
+	}
+	m = file->private_data;
+	m->private = private;
+	return private;
+}
+
+int seq_release_private(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	free(m->private);
+	return seq_release(inode, file);
+}
+
+int single_open(struct file *file, int (*show)(struct seq_file *m, void *v),
+		void *data)
+{
+	struct seq_file *m = calloc(1, sizeof(*m));
+
+	if (!m)
+		return -ENOMEM;
+	m->single_show = show;
+	m->private = data;
+	file->private_data = m;
+	return 0;
+}
+
+int single_release(struct inode *inode, struct file *file)
+{
+	return seq_release(inode, file);
+}
+
+int simple_open(struct inode *inode, struct file *file)
+{
+	return 0;
+}
+
+/* procfs, debugfs and misc devices */
+#define SIM_MAX_FILES 1024
+
+/* A directory is an entry without file operations */
+static const struct file_operations sim_dir_fops;
+
+/* data is owned by the entry when free_data is set */
+static struct sim_file {
+	char path[96];
+	const struct file_operations *fops;
+	void *data;
+	bool free_data;
+	struct file_operations proc_fops; /* converted from proc_ops */
+} sim_files[SIM_MAX_FILES];
+
+static struct sim_file *sim_file_add_data(const char *dir, const char *name,
+					  const struct file_operations *fops,
+					  void *data, bool free_data)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_FILES; i++) {
+		if (sim_files[i].fops)
+			continue;
+		if (snprintf(sim_files[i].path, sizeof(sim_files[i].path),
+			     "%s%s%s", dir, *dir ? "/" : "", name) >=
+		    sizeof(sim_files[i].path))
+			return NULL;
+		sim_files[i].fops = fops;
+		sim_files[i].data = data;
+		sim_files[i].free_data = free_data;
+		return &sim_files[i];
+	}
+	return NULL;
+}
+
+static struct dentry *sim_file_add(const char *dir, const char *name,
+				   const struct file_operations *fops)
+{
+	return (struct dentry *)sim_file_add_data(dir, name, fops, NULL, false);
+}
+
+static struct sim_file *sim_file_find(const char *path)
+{
+	int i;
+
+	for (i = 0; i < SIM_MAX_FILES; i++) {
+		if (sim_files[i].fops && !strcmp(sim_files[i].path, path))
+			return &sim_files[i];
+	}
+	return NULL;
+}
+
+/* Remove path and everything below it */
+static void sim_file_remove(const char *path)
+{
+	size_t len = strlen(path);
+	int i;
+
+	for (i = 0; i < SIM_MAX_FILES; i++) {
+		if (!strncmp(sim_files[i].path, path, len) &&
+		    (!sim_files[i].path[len] || sim_files[i].path[len] == '/')) {
+			if (sim_files[i].free_data)
+				free(sim_files[i].data);
+			memset(&sim_files[i], 0, sizeof(sim_files[i]));
+		}
+	}
+}
+
+struct proc_dir_entry *proc_create(const char *name, umode_t mode,
+				   struct proc_dir_entry *parent,
+				   const struct proc_ops *proc_ops)
+{
+	struct sim_file *entry;
+
+	entry = sim_file_add_data("proc", name, &sim_dir_fops, NULL, false);
+	if (!entry)
+		return NULL;
+	entry->proc_fops = (struct file_operations){
+		.open = proc_ops->proc_open,
+		.read = proc_ops->proc_read,
+		.write = proc_ops->proc_write,
+		.llseek = proc_ops->proc_lseek,
+		.release = proc_ops->proc_release,
+		.poll = proc_ops->proc_poll,
+	};
+	entry->fops = &entry->proc_fops;
+	return (struct proc_dir_entry *)entry;
+}
+
+void remove_proc_entry(const char *name, struct proc_dir_entry *parent)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "proc/%s", name);
+	sim_file_remove(path);
+}
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+	return sim_file_add("debugfs", name, &sim_dir_fops);
+}
+
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops)
+{
+	const char *dir = parent ? (const char *)parent : "debugfs";
+
+	return sim_file_add(dir, name, fops);
+}
+
+void debugfs_remove_recursive(struct dentry *dentry)
+{
+	char path[96];
+
+	if (!dentry)
+		return;
+	snprintf(path, sizeof(path), "%s", (const char *)dentry);
+	sim_file_remove(path);
+}
+
+int misc_register(struct miscdevice *misc)
+{
+	static struct device sim_misc_device;
+	char path[64];
+
+	snprintf(sim_misc_device.kobj.path, sizeof(sim_misc_device.kobj.path),
+		 "dev/%s", misc->name);
+	misc->this_device = &sim_misc_device;
+
+	snprintf(path, sizeof(path), "dev");
+	return sim_file_add(path, misc->name, misc->fops) ? 0 : -ENOMEM;
+}
+
+void misc_deregister(struct miscdevice *misc)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "dev/%s", misc->name);
+	sim_file_remove(path);
+}
+
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		       char *envp[])
+{
+	int i;
+
+	if (!sim_verbose)
+		return 0;
+
+	fprintf(stderr, "uevent: change %s", kobj->path);
+	for (i = 0; envp[i]; i++)
+		fprintf(stderr, " %s", envp[i]);
+	fprintf(stderr, "\n");
+	return 0;
+}
+
+/* sysfs, an attribute file reads and writes through show and store */
+static struct kobject sim_kernel_kobj = { .path = "sys/kernel" };
+struct kobject *kernel_kobj = &sim_kernel_kobj;
+
+struct sim_sysfs_attr {
+	struct kobject *kobj;
+	struct kobj_attribute *kattr;
+};
+
+static ssize_t sim_sysfs_read(struct file *file, char __user *buf,
+			      size_t len, loff_t *pos)
+{
+	struct sim_sysfs_attr *sattr = file->private_data;
+	char page[PAGE_SIZE];
+	ssize_t ret;
+
+	if (!sattr->kattr->show)
+		return -EIO;
+	// Like sysfs, call show once per open, the page fits in one read
+	if (*pos)
+		return 0;
+	ret = sattr->kattr->show(sattr->kobj, sattr->kattr, page);
+	if (ret < 0)
+		return ret;
+
+	len = min((size_t)ret, len);
+	memcpy(buf, page, len);
+	*pos += len;
+	return len;
+}
+
+static ssize_t sim_sysfs_write(struct file *file, const char __user *buf,
+			       size_t len, loff_t *pos)
+{
+	struct sim_sysfs_attr *sattr = file->private_data;
+	char page[PAGE_SIZE];
+
+	if (!sattr->kattr->store)
+		return -EIO;
+	if (len >= PAGE_SIZE)
+		return -EINVAL;
+	memcpy(page, buf, len);
+	page[len] = '\0';
+	return sattr->kattr->store(sattr->kobj, sattr->kattr, page, len);
+}
+
+static const struct file_operations sim_sysfs_fops = {
+	.read = sim_sysfs_read,
+	.write = sim_sysfs_write,
+};
+
+struct kobject *kobject_create_and_add(const char *name,
+				       struct kobject *parent)
+{
+	struct kobject *kobj = calloc(1, sizeof(*kobj));
+	struct sim_file *dir;
+
+	if (!kobj)
+		return NULL;
+	dir = sim_file_add_data(parent->path, name, &sim_dir_fops, NULL, false);
+	if (!dir) {
+		free(kobj);
+		return NULL;
+	}
+	memcpy(kobj->path, dir->path, sizeof(kobj->path));
+	return kobj;
+}
+
+void kobject_put(struct kobject *kobj)
+{
+	if (!kobj)
+		return;
+	sim_file_remove(kobj->path);
+	free(kobj);
+}
+
+int sysfs_create_file(struct kobject *kobj, const struct attribute *attr)
+{
+	struct sim_sysfs_attr *sattr = malloc(sizeof(*sattr));
+
+	if (!sattr)
+		return -ENOMEM;
+	sattr->kobj = kobj;
+	sattr->kattr = container_of(attr, struct kobj_attribute, attr);
+	if (!sim_file_add_data(kobj->path, attr->name, &sim_sysfs_fops, sattr,
+			       true)) {
+		free(sattr);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+int sysfs_create_group(struct kobject *kobj,
+		       const struct attribute_group *grp)
+{
+	struct attribute **attr;
+	int ret;
+
+	for (attr = grp->attrs; *attr; attr++) {
+		ret = sysfs_create_file(kobj, *attr);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/* Like strcmp, but a trailing newline on either string is ignored */
+bool sysfs_streq(const char *s1, const char *s2)
+{
+	while (*s1 && *s1 == *s2) {
+		s1++;
+		s2++;
+	}
+	if (*s1 == *s2)
+		return true;
+	if (!*s1 && *s2 == '\n' && !s2[1])
+		return true;
+	return *s1 == '\n' && !s1[1] && !*s2;
+}
+
+int __sysfs_match_string(const char *const *array, size_t n, const char *s)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (array[i] && sysfs_streq(array[i], s))
+			return i;
+	}
+	return -EINVAL;
+}
+
+struct file *sim_open(const char *path, fmode_t mode)
+{
+	struct sim_file *entry = sim_file_find(path);
+	const struct file_operations *fops;
+	struct file *file;
+
+	if (!entry || entry->fops == &sim_dir_fops)
+		return NULL;
+	fops = entry->fops;
+
+	file = calloc(1, sizeof(*file));
+	if (!file)
+		return NULL;
+	file->f_op = fops;
+	file->f_mode = mode;
+	file->private_data = entry->data;
+
+	if (fops->open && fops->open(NULL, file)) {
+		free(file);
+		return NULL;
+	}
+	return file;
+}
+
+void sim_close(struct file *file)
+{
+	if (file->f_op->release)
+		file->f_op->release(NULL, file);
+	free(file);
+}
@@ -0,0 +1,753 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * Just enough of the kernel API, implemented on top of libc and pthreads,
+ * to build nuc_led.c into a userspace program. Only the parts the driver
+ * uses are here, and only with the semantics it relies on. The proc,
+ * debugfs and device files the driver creates are kept in a registry
+ * and opened with sim_open().
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Types and annotations */
+typedef __u8 u8;
+typedef __u16 u16;
+typedef __u32 u32;
+typedef __u64 u64;
+typedef __s8 s8;
+typedef __s16 s16;
+typedef __s32 s32;
+typedef __s64 s64;
+typedef s64 ktime_t;
+typedef unsigned int gfp_t;
+typedef unsigned int fmode_t;
+typedef unsigned short umode_t;
+
+#define __user
+#define __init
+#define __exit
+#define __rcu
+#define __percpu
+#define __read_mostly
+#define __packed __attribute__((packed))
+#define __maybe_unused __attribute__((unused))
+#define likely(x) __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+#define IS_ENABLED(option) 0
+
+/* The simulated kernel, new enough for proc_ops */
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + ((c) > 255 ? 255 : (c)))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 6, 0)
+
+#define KBUILD_MODNAME "nuc_led"
+struct module;
+#define THIS_MODULE ((struct module *)NULL)
+#define MODULE_AUTHOR(x)
+#define MODULE_DESCRIPTION(x)
+#define MODULE_LICENSE(x)
+#define MODULE_ALIAS(x)
+#define MODULE_PARM_DESC(name, desc)
+/* Parameters are plain variables, set them before calling the init function */
+#define module_param(name, type, perm)
+struct kernel_param {
+	void *arg;
+};
+struct kernel_param_ops {
+	int (*set)(const char *val, const struct kernel_param *kp);
+	int (*get)(char *buf, const struct kernel_param *kp);
+};
+#define module_param_cb(name, ops, arg, perm)
+#define module_init(fn)
+#define module_exit(fn)
+
+/* Helpers */
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(cond) ((void)sizeof(char[1 - 2 * !!(cond)]))
+#define container_of(ptr, type, member)                                        \
+	((type *)((char *)(ptr)-offsetof(type, member)))
+#define BIT(nr) (1UL << (nr))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(type, a, b) min((type)(a), (type)(b))
+#define max_t(type, a, b) max((type)(a), (type)(b))
+#define clamp_t(type, val, lo, hi) min_t(type, max_t(type, val, lo), hi)
+#define DIV_ROUND_UP(n, d) (((n) + (d)-1) / (d))
+#define DIV_ROUND_CLOSEST(x, d) (((x) + ((d) / 2)) / (d))
+#define U64_MAX UINT64_MAX
+
+#define READ_ONCE(x) (*(const volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val) (*(volatile __typeof__(x) *)&(x) = (val))
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_rmb() __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+#define MAX_ERRNO 4095
+#define IS_ERR(ptr) ((unsigned long)(ptr) >= (unsigned long)-MAX_ERRNO)
+#define PTR_ERR(ptr) ((long)(ptr))
+#define ERR_PTR(err) ((void *)(long)(err))
+#define ERESTARTSYS 512
+
+static inline u64 div_u64(u64 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+/* Integer square root, rounded down */
+static inline u32 int_sqrt64(u64 x)
+{
+	u64 root = 0, bit;
+
+	for (bit = 1ULL << 62; bit; bit >>= 2) {
+		if (x >= root + bit) {
+			x -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+	}
+	return root;
+}
+
+static inline u64 div_u64_rem(u64 dividend, u32 divisor, u32 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline int ilog2(u64 n)
+{
+	return 63 - __builtin_clzll(n);
+}
+
+/* Logging, warnings go to stderr, info only when sim_verbose is set */
+extern int sim_verbose;
+
+#ifndef pr_fmt
+#define pr_fmt(fmt) fmt
+#endif
+#define pr_warn(fmt, ...) fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__)
+#define pr_warn_ratelimited pr_warn
+#define pr_info(fmt, ...)                                                      \
+	do {                                                                   \
+		if (sim_verbose)                                               \
+			fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__);           \
+	} while (0)
+#define pr_debug(fmt, ...)                                                     \
+	do {                                                                   \
+		if (sim_verbose > 1)                                           \
+			fprintf(stderr, pr_fmt(fmt), ##__VA_ARGS__);           \
+	} while (0)
+
+/* Memory, user pointers are plain pointers */
+#define GFP_KERNEL 0
+#define PAGE_SIZE 4096UL
+
+static inline void *kmalloc(size_t size, gfp_t flags)
+{
+	return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t flags)
+{
+	return calloc(1, size);
+}
+
+static inline void *kcalloc(size_t n, size_t size, gfp_t flags)
+{
+	return calloc(n, size);
+}
+
+static inline void kfree(const void *ptr)
+{
+	free((void *)ptr);
+}
+
+#define vzalloc(size) kzalloc(size, GFP_KERNEL)
+#define vfree(ptr) kfree(ptr)
+
+static inline unsigned long get_zeroed_page(gfp_t flags)
+{
+	void *page = NULL;
+
+	if (posix_memalign(&page, PAGE_SIZE, PAGE_SIZE))
+		return 0;
+	memset(page, 0, PAGE_SIZE);
+	return (unsigned long)page;
+}
+
+static inline void free_page(unsigned long addr)
+{
+	free((void *)addr);
+}
+
+static inline unsigned long copy_from_user(void *to, const void *from,
+					   unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+static inline unsigned long copy_to_user(void *to, const void *from,
+					 unsigned long n)
+{
+	memcpy(to, from, n);
+	return 0;
+}
+
+#define get_user(x, ptr) ((x) = *(ptr), 0)
+#define put_user(x, ptr) (*(ptr) = (x), 0)
+#define u64_to_user_ptr(x) ((void *)(uintptr_t)(x))
+
+void *memdup_user(const void *src, size_t len);
+void *memdup_user_nul(const void *src, size_t len);
+
+/* Strings */
+int kstrtou8(const char *s, unsigned int base, u8 *res);
+int kstrtou16(const char *s, unsigned int base, u16 *res);
+int kstrtouint(const char *s, unsigned int base, unsigned int *res);
+char *strim(char *s);
+ssize_t strscpy(char *dest, const char *src, size_t count);
+
+/* Time, one jiffy is a millisecond */
+#define HZ 1000
+#define NSEC_PER_SEC 1000000000L
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_USEC 1000L
+#define USEC_PER_SEC 1000000L
+
+ktime_t ktime_get(void);
+#define jiffies ((unsigned long)(ktime_get() / NSEC_PER_MSEC))
+
+static inline ktime_t ktime_sub(ktime_t a, ktime_t b)
+{
+	return a - b;
+}
+
+static inline s64 ktime_to_ns(ktime_t t)
+{
+	return t;
+}
+
+static inline s64 ktime_ms_delta(ktime_t later, ktime_t earlier)
+{
+	return (later - earlier) / NSEC_PER_MSEC;
+}
+
+static inline unsigned long msecs_to_jiffies(unsigned int ms)
+{
+	return ms;
+}
+
+static inline unsigned long nsecs_to_jiffies(u64 ns)
+{
+	return ns / NSEC_PER_MSEC;
+}
+
+void udelay(unsigned long usecs);
+void usleep_range(unsigned long min, unsigned long max);
+void msleep(unsigned int msecs);
+unsigned long msleep_interruptible(unsigned int msecs);
+void cond_resched(void);
+
+/* Locking */
+struct mutex {
+	pthread_mutex_t lock;
+};
+
+#define DEFINE_MUTEX(name) struct mutex name = { PTHREAD_MUTEX_INITIALIZER }
+
+static inline void mutex_lock(struct mutex *m)
+{
+	pthread_mutex_lock(&m->lock);
+}
+
+static inline int mutex_trylock(struct mutex *m)
+{
+	return !pthread_mutex_trylock(&m->lock);
+}
+
+static inline void mutex_unlock(struct mutex *m)
+{
+	pthread_mutex_unlock(&m->lock);
+}
+
+#define lockdep_assert_held(m) ((void)(m))
+#define lockdep_is_held(m) 1
+
+typedef struct {
+	s64 counter;
+} atomic64_t;
+
+#define ATOMIC64_INIT(i) { (i) }
+#define atomic64_read(v) __atomic_load_n(&(v)->counter, __ATOMIC_RELAXED)
+#define atomic64_inc(v) __atomic_fetch_add(&(v)->counter, 1, __ATOMIC_RELAXED)
+
+/* Per-CPU data, there is a single copy updated atomically */
+#define DEFINE_PER_CPU(type, name) __typeof__(type) name
+#define this_cpu_inc(var) __atomic_fetch_add(&(var), 1, __ATOMIC_RELAXED)
+#define per_cpu(var, cpu) (var)
+#define for_each_possible_cpu(cpu) for ((cpu) = 0; (cpu) < 1; (cpu)++)
+
+/*
+ * RCU, readers hold a read lock that a grace period takes for writing.
+ * Read sections must not nest or sleep for long, as in the kernel.
+ */
+extern pthread_rwlock_t sim_rcu_lock;
+
+#define rcu_read_lock() pthread_rwlock_rdlock(&sim_rcu_lock)
+#define rcu_read_unlock() pthread_rwlock_unlock(&sim_rcu_lock)
+#define rcu_dereference(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_access_pointer(p) __atomic_load_n(&(p), __ATOMIC_RELAXED)
+#define rcu_assign_pointer(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+void synchronize_rcu(void);
+unsigned long get_state_synchronize_rcu(void);
+void cond_synchronize_rcu(unsigned long oldstate);
+bool poll_state_synchronize_rcu(unsigned long oldstate);
+
+struct rcu_head {
+	struct rcu_head *next;
+	unsigned long state; /* freed once the grace period after it is over */
+	void *ptr;
+};
+
+void sim_kfree_rcu(void *ptr, struct rcu_head *head);
+#define kfree_rcu(ptr, field) sim_kfree_rcu(ptr, &(ptr)->field)
+
+/* Lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+#define LIST_HEAD(name) struct list_head name = { &(name), &(name) }
+
+static inline void list_add_tail(struct list_head *entry,
+				 struct list_head *head)
+{
+	entry->prev = head->prev;
+	entry->next = head;
+	head->prev->next = entry;
+	head->prev = entry;
+}
+
+static inline void list_del(struct list_head *entry)
+{
+	entry->prev->next = entry->next;
+	entry->next->prev = entry->prev;
+	entry->next = entry->prev = NULL;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+	return head->next == head;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry_or_null(head, type, member)                           \
+	(list_empty(head) ? NULL : list_entry((head)->next, type, member))
+#define list_for_each_entry(pos, head, member)                                 \
+	for (pos = list_entry((head)->next, __typeof__(*pos), member);         \
+	     &pos->member != (head);                                           \
+	     pos = list_entry(pos->member.next, __typeof__(*pos), member))
+
+/* Work queues, run by a single worker thread */
+struct work_struct;
+typedef void (*work_func_t)(struct work_struct *work);
+
+struct work_struct {
+	work_func_t func;
+	bool pending;
+	bool running;
+	ktime_t due;
+	unsigned long completed;
+};
+
+struct delayed_work {
+	struct work_struct work;
+};
+
+struct workqueue_struct;
+#define system_wq ((struct workqueue_struct *)NULL)
+
+#define DECLARE_WORK(name, fn) struct work_struct name = { .func = (fn) }
+#define DECLARE_DELAYED_WORK(name, fn)                                         \
+	struct delayed_work name = { .work = { .func = (fn) } }
+
+bool queue_work(struct workqueue_struct *wq, struct work_struct *work);
+bool queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+			unsigned long delay);
+bool mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *dwork,
+		      unsigned long delay);
+bool cancel_delayed_work_sync(struct delayed_work *dwork);
+bool flush_work(struct work_struct *work);
+bool flush_delayed_work(struct delayed_work *dwork);
+#define schedule_work(work) queue_work(system_wq, work)
+#define schedule_delayed_work(dwork, delay)                                    \
+	queue_delayed_work(system_wq, dwork, delay)
+
+/* Power management, sim_pm_notify() plays the notifications of a cycle */
+struct notifier_block {
+	int (*notifier_call)(struct notifier_block *nb, unsigned long action,
+			     void *data);
+	struct notifier_block *next;
+};
+
+#define NOTIFY_DONE 0x0000
+#define PM_HIBERNATION_PREPARE 0x0001
+#define PM_POST_HIBERNATION 0x0002
+#define PM_SUSPEND_PREPARE 0x0003
+#define PM_POST_SUSPEND 0x0004
+#define PM_RESTORE_PREPARE 0x0005
+#define PM_POST_RESTORE 0x0006
+
+int register_pm_notifier(struct notifier_block *nb);
+int unregister_pm_notifier(struct notifier_block *nb);
+void sim_pm_notify(unsigned long action);
+
+/* Completions, signals can't interrupt waiting */
+struct completion {
+	bool done;
+};
+
+#define DECLARE_COMPLETION(name) struct completion name = { .done = false }
+
+void complete_all(struct completion *x);
+void reinit_completion(struct completion *x);
+void wait_for_completion(struct completion *x);
+
+static inline int wait_for_completion_killable(struct completion *x)
+{
+	wait_for_completion(x);
+	return 0;
+}
+
+/* Wait queues, a waiter sleeps until the next wake up and checks again */
+typedef struct {
+	unsigned long wakeups;
+} wait_queue_head_t;
+
+#define DECLARE_WAIT_QUEUE_HEAD(name) wait_queue_head_t name = { 0 }
+
+void wake_up_interruptible(wait_queue_head_t *wq);
+unsigned long sim_wait_start(wait_queue_head_t *wq);
+void sim_wait(wait_queue_head_t *wq, unsigned long wakeups);
+
+#define wait_event_interruptible(wq, condition)                                \
+	({                                                                     \
+		unsigned long __wakeups;                                       \
+		while (__wakeups = sim_wait_start(&(wq)), !(condition))        \
+			sim_wait(&(wq), __wakeups);                            \
+		0;                                                             \
+	})
+
+/* Threads */
+struct task_struct;
+
+struct task_struct *sim_kthread_run(int (*fn)(void *data), void *data);
+#define kthread_run(fn, data, namefmt, ...) sim_kthread_run(fn, data)
+bool kthread_should_stop(void);
+int kthread_stop(struct task_struct *task);
+
+/* Files */
+struct inode;
+struct vm_area_struct;
+
+struct file_operations;
+
+struct file {
+	const struct file_operations *f_op;
+	fmode_t f_mode;
+	unsigned int f_flags;
+	void *private_data;
+};
+
+#define O_NONBLOCK 04000
+
+/* poll() only reports readiness, there is nothing to register with */
+typedef unsigned int __poll_t;
+typedef struct poll_table_struct poll_table;
+
+#define EPOLLIN 0x0001
+#define EPOLLRDNORM 0x0040
+
+static inline void poll_wait(struct file *file, wait_queue_head_t *wq,
+			     poll_table *p)
+{
+}
+
+#define FMODE_READ 0x1
+#define FMODE_WRITE 0x2
+
+struct file_operations {
+	struct module *owner;
+	int (*open)(struct inode *inode, struct file *file);
+	ssize_t (*read)(struct file *file, char *buf, size_t len, loff_t *ppos);
+	ssize_t (*write)(struct file *file, const char *buf, size_t len,
+			 loff_t *ppos);
+	loff_t (*llseek)(struct file *file, loff_t offset, int whence);
+	int (*release)(struct inode *inode, struct file *file);
+	long (*unlocked_ioctl)(struct file *file, unsigned int cmd,
+			       unsigned long arg);
+	long (*compat_ioctl)(struct file *file, unsigned int cmd,
+			     unsigned long arg);
+	int (*mmap)(struct file *file, struct vm_area_struct *vma);
+	__poll_t (*poll)(struct file *file, poll_table *wait);
+};
+
+/* Userspace pointers are the same for 32-bit callers */
+static inline long compat_ptr_ioctl(struct file *file, unsigned int cmd,
+				    unsigned long arg)
+{
+	return file->f_op->unlocked_ioctl(file, cmd, arg);
+}
+
+/* procfs entries have their own operations since 5.6 */
+struct proc_ops {
+	int (*proc_open)(struct inode *inode, struct file *file);
+	ssize_t (*proc_read)(struct file *file, char *buf, size_t len,
+			     loff_t *ppos);
+	ssize_t (*proc_write)(struct file *file, const char *buf, size_t len,
+			      loff_t *ppos);
+	loff_t (*proc_lseek)(struct file *file, loff_t offset, int whence);
+	int (*proc_release)(struct inode *inode, struct file *file);
+	__poll_t (*proc_poll)(struct file *file, poll_table *wait);
+};
+
+#define S_IRUGO (S_IRUSR | S_IRGRP | S_IROTH)
+
+int simple_open(struct inode *inode, struct file *file);
+
+/* seq_file, the whole file is rendered on the first read */
+struct seq_file;
+
+struct seq_operations {
+	void *(*start)(struct seq_file *m, loff_t *pos);
+	void (*stop)(struct seq_file *m, void *v);
+	void *(*next)(struct seq_file *m, void *v, loff_t *pos);
+	int (*show)(struct seq_file *m, void *v);
+};
+
+struct seq_file {
+	char *buf;
+	size_t size;
+	size_t count;
+	bool rendered;
+	const struct seq_operations *op;
+	int (*single_show)(struct seq_file *m, void *v);
+	void *private;
+	struct mutex lock;
+};
+
+void seq_printf(struct seq_file *m, const char *fmt, ...)
+	__attribute__((format(printf, 2, 3)));
+void seq_puts(struct seq_file *m, const char *s);
+void seq_putc(struct seq_file *m, char c);
+#define SEQ_START_TOKEN ((void *)1)
+int seq_open(struct file *file, const struct seq_operations *op);
+void *__seq_open_private(struct file *file, const struct seq_operations *op,
+			 int psize);
+ssize_t seq_read(struct file *file, char *buf, size_t len, loff_t *ppos);
+loff_t seq_lseek(struct file *file, loff_t offset, int whence);
+#define noop_llseek NULL
+int seq_release(struct inode *inode, struct file *file);
+int seq_release_private(struct inode *inode, struct file *file);
+int single_open(struct file *file, int (*show)(struct seq_file *m, void *v),
+		void *data);
+int single_release(struct inode *inode, struct file *file);
+
+#define DEFINE_SHOW_ATTRIBUTE(__name)                                          \
+	static int __name##_open(struct inode *inode, struct file *file)       \
+	{                                                                      \
+		return single_open(file, __name##_show, NULL);                 \
+	}                                                                      \
+                                                                               \
+	static const struct file_operations __name##_fops = {                  \
+		.owner = THIS_MODULE,                                          \
+		.open = __name##_open,                                         \
+		.read = seq_read,                                              \
+		.llseek = seq_lseek,                                           \
+		.release = single_release,                                     \
+	}
+
+/* procfs, debugfs, sysfs and misc devices are looked up by name */
+struct proc_dir_entry;
+struct dentry;
+struct device;
+
+typedef struct {
+	unsigned int val;
+} kuid_t;
+typedef struct {
+	unsigned int val;
+} kgid_t;
+
+#define make_kuid(ns, uid) ((kuid_t){ uid })
+#define make_kgid(ns, gid) ((kgid_t){ gid })
+#define uid_valid(uid) ((uid).val != (unsigned int)-1)
+#define gid_valid(gid) ((gid).val != (unsigned int)-1)
+
+struct proc_dir_entry *proc_create(const char *name, umode_t mode,
+				   struct proc_dir_entry *parent,
+				   const struct proc_ops *proc_ops);
+void remove_proc_entry(const char *name, struct proc_dir_entry *parent);
+#define proc_set_user(de, uid, gid) ((void)(de))
+
+struct dentry *debugfs_create_dir(const char *name, struct dentry *parent);
+struct dentry *debugfs_create_file(const char *name, umode_t mode,
+				   struct dentry *parent, void *data,
+				   const struct file_operations *fops);
+void debugfs_remove_recursive(struct dentry *dentry);
+
+#define MISC_DYNAMIC_MINOR 255
+
+struct miscdevice {
+	int minor;
+	const char *name;
+	const struct file_operations *fops;
+	umode_t mode;
+	struct device *this_device;
+};
+
+int misc_register(struct miscdevice *misc);
+void misc_deregister(struct miscdevice *misc);
+
+/* A kobject is its sysfs directory, kernel_kobj is "sys/kernel" */
+struct kobject {
+	char path[96];
+};
+
+/* Misc devices get one, uevents are printed with -v */
+struct device {
+	struct kobject kobj;
+};
+
+enum kobject_action {
+	KOBJ_CHANGE = 2,
+};
+
+int kobject_uevent_env(struct kobject *kobj, enum kobject_action action,
+		       char *envp[]);
+
+struct attribute {
+	const char *name;
+	umode_t mode;
+};
+
+struct kobj_attribute {
+	struct attribute attr;
+	ssize_t (*show)(struct kobject *kobj, struct kobj_attribute *attr,
+			char *buf);
+	ssize_t (*store)(struct kobject *kobj, struct kobj_attribute *attr,
+			 const char *buf, size_t count);
+};
+
+struct attribute_group {
+	const char *name;
+	struct attribute **attrs;
+};
+
+extern struct kobject *kernel_kobj;
+
+#define sysfs_attr_init(attr) do {} while (0)
+
+struct kobject *kobject_create_and_add(const char *name,
+				       struct kobject *parent);
+void kobject_put(struct kobject *kobj);
+int sysfs_create_file(struct kobject *kobj, const struct attribute *attr);
+int sysfs_create_group(struct kobject *kobj,
+		       const struct attribute_group *grp);
+bool sysfs_streq(const char *s1, const char *s2);
+int __sysfs_match_string(const char *const *array, size_t n, const char *s);
+#define sysfs_match_string(array, s)                                           \
+	__sysfs_match_string(array, ARRAY_SIZE(array), s)
+
+/* mmap is not available, the shared page can be read directly */
+struct page;
+
+struct vm_area_struct {
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	unsigned long vm_flags;
+};
+
+#define VM_WRITE 0x2
+#define VM_MAYWRITE 0x20
+
+static inline void vm_flags_clear(struct vm_area_struct *vma,
+				  unsigned long flags)
+{
+	vma->vm_flags &= ~flags;
+}
+#define virt_to_page(addr) ((struct page *)(addr))
+#define vm_insert_page(vma, addr, page) (-ENODEV)
+
+/*
+ * Open a file created by the driver: "proc/nuc_led", "dev/nuc_led",
+ * "debugfs/nuc_led/<name>" or "sys/kernel/nuc_led/...". NULL if it does
+ * not exist or can't be opened.
+ */
+struct file *sim_open(const char *path, fmode_t mode);
+void sim_close(struct file *file);
+
+/* ACPI and WMI, there is no firmware: only the sim backend works */
+typedef u32 acpi_status;
+typedef u64 acpi_size;
+
+struct acpi_buffer {
+	acpi_size length;
+	void *pointer;
+};
+
+union acpi_object {
+	u32 type;
+	struct {
+		u32 type;
+		u32 length;
+		u8 *pointer;
+	} buffer;
+};
+
+#define ACPI_TYPE_BUFFER 3
+#define ACPI_ALLOCATE_BUFFER ((acpi_size)-1)
+#define AE_NOT_EXIST 6
+#define ACPI_FAILURE(status) ((status) != 0)
+#define ACPI_EXCEPTION(args)
+#define ACPI_MODULE_NAME(name)
+
+#define wmi_has_guid(guid) false
+static inline acpi_status wmi_evaluate_method(const char *guid, u8 instance,
+					      u32 method_id,
+					      const struct acpi_buffer *in,
+					      struct acpi_buffer *out)
+{
+	return AE_NOT_EXIST;
+}
+
+extern struct proc_dir_entry *acpi_root_dir;
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * Intel NUC NUC8i7HVK (Hades) LED Control WMI Driver
+ *
+ * nuc_led_sim: runs the driver in userspace against the simulated
+ * firmware backend. Every command argument (or stdin, if there are none)
+ * is written to /proc/acpi/nuc_led as one batch, then the files given
+ * with -R and -W are read and written in order, and the state is printed
+ * the way reading /proc/acpi/nuc_led would.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ */
+
+#include <getopt.h>
+#include <unistd.h>
+
+#include "../nuc_led.c"
+
+static void usage(int status)
+{
+	fprintf(status ? stderr : stdout,
+		"usage: nuc_led_sim [-abhqsSv] [-l latency_us] [-f fail_every] [-c fail_code]\n"
+		"                   [-r max_hz] [-o format] [-g gamma] [-t threshold]\n"
+		"                   [-R file] [-W file=value]\n"
+		"                   [command...]\n"
+		"\n"
+		"  -a  queue writes (async_writes=1)\n"
+		"  -b  print the result of each command line with the state it left\n"
+		"  -l  time each firmware call takes\n"
+		"  -f  fail every Nth firmware call\n"
+		"  -c  return code of failed calls, 0 to fail the evaluation\n"
+		"  -r  rate limit per LED (max_hz)\n"
+		"  -o  output format: text, json or kv (output_format)\n"
+		"  -g  gamma times 100 of colors (color_gamma)\n"
+		"  -t  smallest color change sent (color_threshold)\n"
+		"  -R  print a file, e.g. sys/kernel/nuc_led/eyes/software/red\n"
+		"  -W  write a value to a file\n"
+		"  -q  don't print the LED state\n"
+		"  -s  print the statistics from debugfs\n"
+		"  -S  suspend and resume after the file operations\n"
+		"  -v  print driver messages, twice for debug messages\n");
+	exit(status);
+}
+
+static ssize_t sim_print(struct file *file)
+{
+	char buf[4096];
+	loff_t pos = 0;
+	ssize_t len;
+
+	while ((len = file->f_op->read(file, buf, sizeof(buf), &pos)) > 0)
+		fwrite(buf, 1, len, stdout);
+	return len;
+}
+
+static int sim_cat(const char *path)
+{
+	struct file *file = sim_open(path, FMODE_READ);
+	ssize_t len;
+
+	if (!file)
+		return -ENOENT;
+
+	len = sim_print(file);
+	sim_close(file);
+	return len;
+}
+
+static int sim_write(const char *path, const char *buf, size_t len)
+{
+	struct file *file = sim_open(path, FMODE_WRITE);
+	loff_t pos = 0;
+	ssize_t ret;
+
+	if (!file)
+		return -ENOENT;
+
+	ret = file->f_op->write(file, buf, len, &pos);
+	sim_close(file);
+	return ret < 0 ? ret : 0;
+}
+
+/* Write a batch of commands, optionally reading the result of each back */
+static int sim_batch(const char *buf, size_t len, bool results)
+{
+	struct file *file = sim_open("proc/nuc_led", FMODE_READ | FMODE_WRITE);
+	loff_t pos = 0;
+	ssize_t ret;
+
+	if (!file)
+		return -ENOENT;
+
+	ret = file->f_op->write(file, buf, len, &pos);
+	if (results)
+		sim_print(file);
+	sim_close(file);
+	return ret < 0 ? ret : 0;
+}
+
+static char *read_stdin(size_t *len)
+{
+	size_t size = 4096;
+	char *buf = malloc(size);
+	size_t n;
+
+	*len = 0;
+	while (buf && (n = fread(buf + *len, 1, size - *len, stdin)) > 0) {
+		*len += n;
+		if (*len == size)
+			buf = realloc(buf, size *= 2);
+	}
+	return buf;
+}
+
+/* Run -R and -W in the order they were given */
+static int sim_file_op(int op, char *arg)
+{
+	char *value;
+
+	if (op == 'R')
+		return sim_cat(arg);
+
+	value = strchr(arg, '=');
+	if (!value)
+		return -EINVAL;
+	*value++ = '\0';
+	return sim_write(arg, value, strlen(value));
+}
+
+int main(int argc, char **argv)
+{
+	bool quiet = false, stats = false, suspend = false, results = false;
+	struct kernel_param format_param = { .arg = &output_format };
+	struct kernel_param gamma_param = { .arg = &color_gamma };
+	char **file_args = calloc(argc, sizeof(*file_args));
+	char *file_ops = calloc(argc, 1);
+	int num_file_ops = 0;
+	size_t len;
+	char *input;
+	int opt, i, ret = 0;
+
+	backend = "sim";
+
+	while ((opt = getopt(argc, argv, "abl:f:c:r:o:g:t:R:W:qsSvh")) != -1) {
+		switch (opt) {
+		case 'a':
+			async_writes = true;
+			break;
+		case 'b':
+			results = true;
+			break;
+		case 'l':
+			sim_latency_us = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			sim_fail_every = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			sim_fail_code = strtol(optarg, NULL, 0);
+			break;
+		case 'r':
+			max_hz = strtoul(optarg, NULL, 0);
+			break;
+		case 'o':
+			if (nuc_led_output_format_set(optarg, &format_param))
+				usage(2);
+			break;
+		case 'g':
+			if (nuc_led_color_gamma_set(optarg, &gamma_param))
+				usage(2);
+			break;
+		case 't':
+			color_threshold = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+		case 'W':
+			file_ops[num_file_ops] = opt;
+			file_args[num_file_ops++] = optarg;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		case 's':
+			stats = true;
+			break;
+		case 'S':
+			suspend = true;
+			break;
+		case 'v':
+			sim_verbose++;
+			break;
+		default:
+			usage(opt == 'h' ? 0 : 2);
+		}
+	}
+
+	if (init_nuc_led())
+		return 1;
+
+	if (optind == argc) {
+		input = read_stdin(&len);
+		if (input && len && sim_batch(input, len, results))
+			ret = 1;
+		free(input);
+	}
+	for (i = optind; i < argc; i++) {
+		if (sim_batch(argv[i], strlen(argv[i]), results))
+			ret = 1;
+	}
+
+	// The sysfs tree appears once the LEDs are probed and registered
+	flush_work(&nuc_led_probe_work);
+	flush_work(&nuc_led_register_work);
+	for (i = 0; i < num_file_ops; i++) {
+		if (sim_file_op(file_ops[i], file_args[i]) < 0) {
+			fprintf(stderr, "-%c %s failed\n", file_ops[i],
+				file_args[i]);
+			ret = 1;
+		}
+	}
+	free(file_args);
+	free(file_ops);
+
+	// The firmware forgets volatile values in between, then they are restored
+	if (suspend) {
+		sim_pm_notify(PM_SUSPEND_PREPARE);
+		sim_pm_notify(PM_POST_SUSPEND);
+		flush_work(&nuc_led_pm_work);
+	}
+
+	// Let queued and rate limited writes reach the firmware
+	nuc_led_queue_flush();
+	flush_delayed_work(&nuc_led_uevent_work);
+
+	if (!quiet) {
+		sim_cat("proc/nuc_led");
+		printf("\n");
+	}
+	if (stats) {
+		sim_cat("debugfs/nuc_led/stats");
+		sim_cat("debugfs/nuc_led/wmi");
+	}
+
+	unload_nuc_led();
+	return ret;
+}